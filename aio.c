@@ -234,24 +234,45 @@ sys_io_submit(struct tcb *tcp)
 			long i;
 			struct iocb **iocbs = (void *)tcp->u_arg[2];
 //FIXME: decoding of 32-bit call by 64-bit strace
+			/*
+			 * iocb pointers, and then iocbs they point to,
+			 * are fetched in batches.
+			 */
+			struct iocb *iocbps[16];
+			struct iocb iocbbuf[ARRAY_SIZE(iocbps)];
+			struct umove_req req[ARRAY_SIZE(iocbps)];
+			unsigned int j, n = 0, k = 0;
 
 			for (i = 0; i < nr; i++, iocbs++) {
 				enum iocb_sub sub;
-				struct iocb *iocbp;
 				struct iocb iocb;
 				if (i)
 					tprints(", ");
 
-				if (umove(tcp, (unsigned long)iocbs, &iocbp)) {
+				if (k == n) {
+					k = 0;
+					n = umove_array(tcp, (unsigned long)iocbs,
+							sizeof(iocbps[0]),
+							MIN(nr - i, (long) ARRAY_SIZE(iocbps)),
+							iocbps);
+					for (j = 0; j < n; ++j) {
+						req[j].addr = (unsigned long)iocbps[j];
+						req[j].len = sizeof(iocbbuf[j]);
+						req[j].laddr = &iocbbuf[j];
+					}
+					umoven_multi(tcp, req, n);
+				}
+				if (k == n) {
 					tprintf("%#lx", (unsigned long)iocbs);
 					/* No point in trying to read iocbs+1 etc */
 					/* (nr can be ridiculously large): */
 					break;
 				}
-				if (umove(tcp, (unsigned long)iocbp, &iocb)) {
-					tprintf("{%#lx}", (unsigned long)iocbp);
+				if (req[k].rc < 0) {
+					tprintf("{%#lx}", (unsigned long)iocbps[k++]);
 					continue;
 				}
+				iocb = iocbbuf[k++];
 				tprints("{");
 				if (iocb.data)
 					tprintf("data:%p, ", iocb.data);
@@ -348,6 +369,9 @@ sys_io_getevents(struct tcb *tcp)
 #ifdef HAVE_LIBAIO_H
 			struct io_event *events = (void *)tcp->u_arg[3];
 			long i, nr = tcp->u_rval;
+			/* io_events are fetched in batches */
+			struct io_event evbuf[16];
+			unsigned int n = 0, k = 0;
 
 			for (i = 0; i < nr; i++, events++) {
 				struct io_event event;
@@ -357,10 +381,18 @@ sys_io_getevents(struct tcb *tcp)
 				else
 					tprints(", ");
 
-				if (umove(tcp, (unsigned long)events, &event) != 0) {
+				if (k == n) {
+					k = 0;
+					n = umove_array(tcp, (unsigned long)events,
+							sizeof(evbuf[0]),
+							MIN(nr - i, (long) ARRAY_SIZE(evbuf)),
+							evbuf);
+				}
+				if (k == n) {
 					tprints("{...}");
 					continue;
 				}
+				event = evbuf[k++];
 				tprintf("{%p, %p, %ld, %ld}", event.data,
 					event.obj, event.res, event.res2);
 			}
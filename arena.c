@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2014 The strace developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Scratch memory for decoders.
+ *
+ * Memory returned by arena_alloc() stays valid until the next stop:
+ * arena_reset() is called before every stop is handled, so decoders
+ * do not free it.  A decoder which is called many times during one stop,
+ * like printstr(), gives its memory back on return with arena_mark()
+ * and arena_release().
+ *
+ * Allocations are carved from blocks.  The first block is kept across
+ * stops and grown on reset to what the stop needed, up to ARENA_KEEP,
+ * so once the decoders of a workload have been seen, they allocate
+ * from it without calling malloc.
+ */
+
+#include "defs.h"
+
+#define ARENA_ALIGN	16
+#define ARENA_BLOCK	(64 * 1024)	/* default block size */
+#define ARENA_KEEP	(2 * 1024 * 1024) /* max size kept across stops */
+
+struct arena_block {
+	struct arena_block *prev;
+	size_t size;		/* of data following the header */
+	size_t used;
+};
+
+#define ARENA_HDR \
+	((sizeof(struct arena_block) + ARENA_ALIGN - 1) & -ARENA_ALIGN)
+#define block_data(b) ((char *) (b) + ARENA_HDR)
+
+static struct arena_block *arena_top;
+/* Bytes allocated since the last reset, and their maximum */
+static size_t arena_in_use;
+static size_t arena_stop_peak;
+/* For -d statistics */
+static size_t arena_peak;
+static unsigned long arena_mallocs;
+
+static void
+push_block(size_t size)
+{
+	struct arena_block *b;
+
+	if (size > (size_t) -1 - ARENA_HDR)
+		die_out_of_memory();
+	b = malloc(ARENA_HDR + size);
+	if (!b)
+		die_out_of_memory();
+	b->prev = arena_top;
+	b->size = size;
+	b->used = 0;
+	arena_top = b;
+	arena_mallocs++;
+}
+
+static void
+pop_block(void)
+{
+	struct arena_block *b = arena_top;
+
+	arena_top = b->prev;
+	free(b);
+}
+
+void *
+arena_alloc(size_t size)
+{
+	struct arena_block *b;
+	void *p;
+
+	if (size > (size_t) -1 - ARENA_ALIGN)
+		die_out_of_memory();
+	size = (size + ARENA_ALIGN - 1) & -ARENA_ALIGN;
+
+	b = arena_top;
+	if (!b || b->size - b->used < size) {
+		push_block(size > ARENA_BLOCK ? size : ARENA_BLOCK);
+		b = arena_top;
+	}
+	p = block_data(b) + b->used;
+	b->used += size;
+
+	arena_in_use += size;
+	if (arena_in_use > arena_stop_peak)
+		arena_stop_peak = arena_in_use;
+	return p;
+}
+
+/*
+ * Return the current position of the arena,
+ * arena_release() frees everything allocated after it.
+ */
+void *
+arena_mark(void)
+{
+	if (!arena_top)
+		push_block(ARENA_BLOCK);
+	return block_data(arena_top) + arena_top->used;
+}
+
+void
+arena_release(void *mark)
+{
+	char *m = mark;
+
+	/* Drop blocks pushed after the mark */
+	while (m < block_data(arena_top) ||
+	       m > block_data(arena_top) + arena_top->used) {
+		arena_in_use -= arena_top->used;
+		pop_block();
+	}
+	arena_in_use -= block_data(arena_top) + arena_top->used - m;
+	arena_top->used = m - block_data(arena_top);
+}
+
+void
+arena_reset(void)
+{
+	size_t want;
+
+	if (!arena_top)
+		return;
+	if (arena_stop_peak > arena_peak)
+		arena_peak = arena_stop_peak;
+
+	while (arena_top->prev)
+		pop_block();
+	want = arena_stop_peak < ARENA_KEEP ? arena_stop_peak : ARENA_KEEP;
+	if (arena_top->size < want || arena_top->size > ARENA_KEEP) {
+		pop_block();
+		push_block(want > ARENA_BLOCK ? want : ARENA_BLOCK);
+	}
+	arena_top->used = 0;
+	arena_in_use = arena_stop_peak = 0;
+}
+
+void
+arena_stats(void)
+{
+	if (arena_stop_peak > arena_peak)
+		arena_peak = arena_stop_peak;
+	fprintf(stderr, "arena: %lu bytes peak per stop, %lu blocks allocated\n",
+		(unsigned long) arena_peak, arena_mallocs);
+}
@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2014 The strace developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Binary capture (--binary) and its offline decoding (--decode).
+ *
+ * A capture is a header followed by records of fixed size, one per event
+ * which would have printed a line: syscall entry and exit, signal, exit
+ * or death of a process, pid change on execve.  Every record is followed
+ * by snapshots of the data the decoders fetched while the event was
+ * processed: umoven() and umovestr() results and fd paths for -y.
+ * When capturing, decoders run as usual, but tprintf() and tprints()
+ * do nothing, so the cost of formatting is not paid.
+ *
+ * When decoding, the records are fed to the same decoders, and the
+ * functions above return the recorded data instead of looking into
+ * the tracee.  The output is the same as if the options given to
+ * --decode were given to the capturing strace, as long as they do not
+ * make decoders fetch data which was not fetched during the capture
+ * (e.g. bigger -s, or -y, -v and -e read=... not used for the capture).
+ */
+
+#include "defs.h"
+
+static const char capture_magic[8] = "strace\0b";
+#define CAPTURE_VERSION 2
+
+struct capture_header {
+	char magic[8];
+	uint32_t version;
+	uint16_t sizeof_long;
+	uint16_t personalities;
+	uint32_t flags;		/* CAPTURE_F_* */
+	uint32_t pad;
+};
+
+struct capture_record {
+	uint32_t type;		/* CAPTURE_* */
+	uint32_t size;		/* of snapshots following the record */
+	int32_t pid;
+	int32_t pers;
+	int64_t sec;		/* wall clock time, for -t */
+	int64_t usec;
+	uint64_t monotonic;	/* CLOCK_MONOTONIC ns, for -r, -T and -c */
+	long arg;		/* scno, signal, wait status or old pid */
+	long u_rval;
+	long u_arg[MAX_ARGS];
+#if defined(LINUX_MIPSN32) || defined(X32)
+	long long ext_arg[MAX_ARGS];
+	long long u_lrval;
+#endif
+	int32_t u_error;
+	int32_t pad;
+};
+
+enum {
+	SNAP_MEM = 1,	/* umoven() */
+	SNAP_STR,	/* umovestr() */
+	SNAP_FDPATH,	/* getfdpath() */
+	SNAP_SIGINFO,	/* siginfo of a signal-delivery-stop */
+};
+
+struct capture_snap {
+	uint32_t kind;		/* SNAP_* */
+	int32_t ret;		/* return value of the function */
+	uint64_t addr;		/* tracee address or fd */
+	uint32_t len;		/* requested length */
+	uint32_t size;		/* of data following, without padding */
+};
+
+#define SNAP_ALIGN 8
+#define SNAP_SIZE(size) \
+	((sizeof(struct capture_snap) + (size) + SNAP_ALIGN - 1) & ~(SNAP_ALIGN - 1))
+
+bool capture_enabled = 0;
+bool capture_decoding = 0;
+
+/* The record being captured or decoded, and its snapshots */
+static struct capture_record rec;
+static char *snaps;
+static unsigned int snaps_len, snaps_size;
+/* Capturing: rec is being filled */
+static bool recording;
+
+static FILE *capture_in;
+static const char *capture_in_name;
+
+void
+capture_start(FILE *fp, unsigned int flags)
+{
+	struct capture_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, capture_magic, sizeof(hdr.magic));
+	hdr.version = CAPTURE_VERSION;
+	hdr.sizeof_long = sizeof(long);
+	hdr.personalities = SUPPORTED_PERSONALITIES;
+	hdr.flags = flags;
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+}
+
+void
+capture_begin(struct tcb *tcp, unsigned int type, long arg)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	rec.type = type;
+	rec.pid = tcp->pid;
+#if SUPPORTED_PERSONALITIES > 1
+	rec.pers = tcp->currpers;
+#endif
+	rec.sec = tv.tv_sec;
+	rec.usec = tv.tv_usec;
+	rec.monotonic = monotonic_ns();
+	if (type == CAPTURE_ENTRY || type == CAPTURE_EXIT) {
+		rec.arg = tcp->scno;
+		memcpy(rec.u_arg, tcp->u_arg, sizeof(rec.u_arg));
+#if defined(LINUX_MIPSN32) || defined(X32)
+		memcpy(rec.ext_arg, tcp->ext_arg, sizeof(rec.ext_arg));
+		rec.u_lrval = tcp->u_lrval;
+#endif
+		rec.u_rval = tcp->u_rval;
+		rec.u_error = tcp->u_error;
+	} else
+		rec.arg = arg;
+	snaps_len = 0;
+	recording = 1;
+}
+
+void
+capture_end(struct tcb *tcp)
+{
+	if (!recording)
+		return;
+	recording = 0;
+	rec.size = snaps_len;
+	fwrite_unlocked(&rec, sizeof(rec), 1, tcp->outf);
+	if (snaps_len)
+		fwrite_unlocked(snaps, snaps_len, 1, tcp->outf);
+}
+
+void
+capture_event(struct tcb *tcp, unsigned int type, long arg)
+{
+	capture_begin(tcp, type, arg);
+	capture_end(tcp);
+}
+
+static void
+put_snap(unsigned int kind, unsigned long addr, int len, int ret,
+	 const void *data, unsigned int size)
+{
+	struct capture_snap *s;
+	unsigned int need = snaps_len + SNAP_SIZE(size);
+
+	if (!recording)
+		return;
+	if (need > snaps_size) {
+		snaps_size = need > 2 * snaps_size ? need : 2 * snaps_size;
+		snaps = realloc(snaps, snaps_size);
+		if (!snaps)
+			die_out_of_memory();
+	}
+	s = (struct capture_snap *) (snaps + snaps_len);
+	memset(s, 0, SNAP_SIZE(size));
+	s->kind = kind;
+	s->ret = ret;
+	s->addr = addr;
+	s->len = len;
+	s->size = size;
+	if (size)
+		memcpy(s + 1, data, size);
+	snaps_len = need;
+}
+
+void
+capture_put_mem(long addr, int len, int ret, const char *laddr)
+{
+	put_snap(SNAP_MEM, addr, len, ret, laddr, ret < 0 ? 0 : len);
+}
+
+void
+capture_put_str(long addr, int len, int ret, const char *laddr)
+{
+	unsigned int size = 0;
+
+	if (ret > 0)
+		size = strnlen(laddr, len) + 1;
+	else if (ret == 0)
+		size = len;
+	put_snap(SNAP_STR, addr, len, ret, laddr, size);
+}
+
+void
+capture_put_fdpath(int fd, int ret, const char *path)
+{
+	put_snap(SNAP_FDPATH, fd, 0, ret, path, ret < 0 ? 0 : ret);
+}
+
+void
+capture_put_siginfo(const siginfo_t *si)
+{
+	put_snap(SNAP_SIGINFO, 0, sizeof(*si), 0, si, sizeof(*si));
+}
+
+static void
+read_or_die(void *buf, size_t size)
+{
+	if (fread(buf, size, 1, capture_in) != 1) {
+		if (ferror(capture_in))
+			perror_msg_and_die("%s", capture_in_name);
+		error_msg_and_die("%s: unexpected end of file", capture_in_name);
+	}
+}
+
+unsigned int
+capture_open(const char *path)
+{
+	struct capture_header hdr;
+
+	capture_in = fopen(path, "r");
+	if (!capture_in)
+		perror_msg_and_die("Can't fopen '%s'", path);
+	capture_in_name = path;
+	read_or_die(&hdr, sizeof(hdr));
+	if (memcmp(hdr.magic, capture_magic, sizeof(hdr.magic)) != 0)
+		error_msg_and_die("%s: not a capture made with --binary", path);
+	if (hdr.version != CAPTURE_VERSION
+	    || hdr.sizeof_long != sizeof(long)
+	    || hdr.personalities != SUPPORTED_PERSONALITIES)
+		error_msg_and_die("%s: capture was made by an incompatible strace",
+				  path);
+	capture_decoding = 1;
+	return hdr.flags;
+}
+
+unsigned int
+capture_next(int *pid, long *arg)
+{
+	int c = getc_unlocked(capture_in);
+
+	if (c == EOF) {
+		if (ferror(capture_in))
+			perror_msg_and_die("%s", capture_in_name);
+		return 0;
+	}
+	ungetc(c, capture_in);
+	read_or_die(&rec, sizeof(rec));
+	if (rec.size > snaps_size) {
+		snaps_size = rec.size;
+		free(snaps);
+		snaps = malloc(snaps_size);
+		if (!snaps)
+			die_out_of_memory();
+	}
+	snaps_len = rec.size;
+	if (snaps_len)
+		read_or_die(snaps, snaps_len);
+	*pid = rec.pid;
+	*arg = rec.arg;
+	return rec.type;
+}
+
+void
+capture_get_syscall(struct tcb *tcp)
+{
+	if (rec.type == CAPTURE_ENTRY) {
+		tcp->scno = rec.arg;
+		memcpy(tcp->u_arg, rec.u_arg, sizeof(rec.u_arg));
+#if defined(LINUX_MIPSN32) || defined(X32)
+		memcpy(tcp->ext_arg, rec.ext_arg, sizeof(rec.ext_arg));
+#endif
+#if SUPPORTED_PERSONALITIES > 1
+		tcp->currpers = rec.pers;
+#endif
+	} else {
+		tcp->u_rval = rec.u_rval;
+#if defined(LINUX_MIPSN32) || defined(X32)
+		tcp->u_lrval = rec.u_lrval;
+#endif
+		tcp->u_error = rec.u_error;
+	}
+}
+
+void
+capture_gettime(struct timeval *tv)
+{
+	if (capture_decoding) {
+		tv->tv_sec = rec.sec;
+		tv->tv_usec = rec.usec;
+	} else
+		gettimeofday(tv, NULL);
+}
+
+uint64_t
+capture_monotonic_ns(void)
+{
+	return capture_decoding ? rec.monotonic : monotonic_ns();
+}
+
+/* Find a snapshot of the given kind which satisfies match() */
+static const struct capture_snap *
+find_snap(unsigned int kind, unsigned long addr, unsigned int len,
+	  int (*match)(const struct capture_snap *, unsigned long, unsigned int))
+{
+	unsigned int off = 0;
+
+	while (off < snaps_len) {
+		const struct capture_snap *s =
+			(const struct capture_snap *) (snaps + off);
+
+		if (s->kind == kind && match(s, addr, len))
+			return s;
+		off += SNAP_SIZE(s->size);
+	}
+	return NULL;
+}
+
+/* The snapshot was taken by the same request */
+static int
+same_request(const struct capture_snap *s, unsigned long addr, unsigned int len)
+{
+	return s->addr == addr && s->len == len;
+}
+
+/* The snapshot covers addr..addr+len */
+static int
+covers(const struct capture_snap *s, unsigned long addr, unsigned int len)
+{
+	return s->ret >= 0 && addr >= s->addr
+		&& addr - s->addr + len <= s->size;
+}
+
+static int
+same_addr(const struct capture_snap *s, unsigned long addr, unsigned int len)
+{
+	return s->addr == addr;
+}
+
+int
+capture_get_mem(long addr, int len, char *laddr)
+{
+	const struct capture_snap *s;
+
+	s = find_snap(SNAP_MEM, addr, len, same_request);
+	if (!s || s->ret >= 0)
+		s = find_snap(SNAP_MEM, addr, len, covers);
+	if (!s || s->ret < 0)
+		return -1;
+	memcpy(laddr, (const char *) (s + 1) + (addr - s->addr), len);
+	return 0;
+}
+
+int
+capture_get_str(long addr, int len, char *laddr)
+{
+	const struct capture_snap *s;
+	unsigned int size;
+
+	s = find_snap(SNAP_STR, addr, len, same_addr);
+	if (!s) {
+		/* The string may have been fetched with umoven() */
+		return capture_get_mem(addr, len, laddr) < 0 ? -1
+			: memchr(laddr, '\0', len) != NULL;
+	}
+	if (s->ret < 0)
+		return -1;
+	size = s->size < (unsigned int) len ? s->size : (unsigned int) len;
+	memcpy(laddr, s + 1, size);
+	if (memchr(laddr, '\0', size))
+		return 1;
+	return size == (unsigned int) len ? 0 : -1;
+}
+
+int
+capture_get_fdpath(int fd, char *buf, unsigned bufsize)
+{
+	const struct capture_snap *s = find_snap(SNAP_FDPATH, fd, 0, same_request);
+	unsigned int size;
+
+	if (!s || s->ret < 0)
+		return -1;
+	size = s->size < bufsize - 1 ? s->size : bufsize - 1;
+	memcpy(buf, s + 1, size);
+	buf[size] = '\0';
+	return size;
+}
+
+int
+capture_get_siginfo(siginfo_t *si)
+{
+	const struct capture_snap *s =
+		find_snap(SNAP_SIGINFO, 0, sizeof(*si), same_request);
+
+	if (!s)
+		return -1;
+	memcpy(si, s + 1, sizeof(*si));
+	return 0;
+}
@@ -34,81 +34,350 @@
  */
 
 #include "defs.h"
+#include <fcntl.h>
+#include "syscall.h"
+
+/*
+ * --latency: log-linear histogram of the times of calls, in nanoseconds.
+ * Values below HIST_SUB have a bucket each, above that every power of two
+ * is split into HIST_SUB buckets, so a bucket is never wider than 1/HIST_SUB
+ * of its lower bound.  Values of 2^HIST_MAX_BITS ns (about 73 minutes)
+ * and more go to the last bucket.
+ */
+#define HIST_SUB_BITS	3
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS	42
+#define HIST_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+int latency_mode = LATENCY_NONE;
 
 /* Per-syscall stats structure */
 struct call_counts {
-	/* system time spent in syscall (not wall clock time) */
-	struct timeval time;
+	/* ns of system time spent in syscall (wall clock time with -w) */
+	uint64_t time;
 	int calls, errors;
+	/* with --latency, the longest call and all of them by wall clock time */
+	uint64_t max;
+	unsigned int *hist;
 };
 
 static struct call_counts *countv[SUPPORTED_PERSONALITIES];
 #define counts (countv[current_personality])
 
-static struct timeval shortest = { 1000000, 0 };
+/* Stats of ioctl calls by _IOC_TYPE of the request */
+static struct call_counts *ioctl_countv[SUPPORTED_PERSONALITIES];
+#define ioctl_counts (ioctl_countv[current_personality])
+#define NIOCTL_TYPES 256
 
-/* On entry, tv is syscall exit timestamp */
-void
-count_syscall(struct tcb *tcp, struct timeval *tv)
+/*
+ * Stats of multiplexed syscalls (ioctl, fcntl, futex, prctl, keyctl)
+ * by their operation: an open addressing hash table for every such
+ * syscall, indexed by scno.
+ */
+struct op_entry {
+	unsigned long op;
+	struct call_counts cc;	/* cc.calls is 0 in free slots */
+};
+
+struct op_table {
+	unsigned int size, used;	/* size is a power of 2 */
+	struct op_entry *tab;
+};
+
+static struct op_table **op_countv[SUPPORTED_PERSONALITIES];
+#define op_counts (op_countv[current_personality])
+
+/* -w: count wall clock time instead of system time */
+bool count_wallclock = 0;
+
+static uint64_t shortest = 1000000000;
+
+/*
+ * --summary-by: stats of a process (thread group) or of a thread,
+ * shared by its tcbs.  They outlive the tcbs and are printed at the end,
+ * or with -ff to the output file of the last tcb when it is dropped.
+ */
+struct proc_counts {
+	struct proc_counts *next;
+	int pid;		/* tgid, or tid with --summary-by=thread */
+	unsigned int refcnt;	/* tcbs counting here now */
+	unsigned int threads;	/* tcbs ever counted here */
+	char comm[17];		/* command name as of the last execve */
+	/* totals with the overhead subtracted, set by proc_totals() */
+	uint64_t time;
+	unsigned int calls, errors;
+	struct call_counts *countv[SUPPORTED_PERSONALITIES];
+};
+
+int summary_by = SUMMARY_BY_NONE;
+/* the number of processes or threads listed and printed, 0 is all */
+unsigned int summary_top = 10;
+static struct proc_counts *proc_list;
+static unsigned int nproc_counts;
+
+static unsigned int
+hist_index(uint64_t ns)
 {
-	struct call_counts *cc;
-	unsigned long scno = tcp->scno;
+	unsigned int e;
 
-	if (!SCNO_IN_RANGE(scno))
-		return;
+	if (ns < HIST_SUB)
+		return ns;
+	if (ns >> HIST_MAX_BITS)
+		return HIST_BUCKETS - 1;
+	e = 63 - __builtin_clzll(ns);
+	return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) |
+		((ns >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* The lowest value which goes to bucket `i' */
+static uint64_t
+hist_low(unsigned int i)
+{
+	unsigned int shift;
 
-	if (!counts) {
-		counts = calloc(nsyscalls, sizeof(*counts));
-		if (!counts)
+	if (i < HIST_SUB)
+		return i;
+	shift = (i >> HIST_SUB_BITS) - 1;
+	return (uint64_t) (HIST_SUB | (i & (HIST_SUB - 1))) << shift;
+}
+
+/* The highest value which goes to bucket `i' */
+static uint64_t
+hist_high(unsigned int i)
+{
+	return i + 1 < HIST_BUCKETS ? hist_low(i + 1) - 1 : (uint64_t) -1;
+}
+
+static void
+count_latency(struct call_counts *cc, uint64_t ns)
+{
+	if (!cc->hist) {
+		cc->hist = calloc(HIST_BUCKETS, sizeof(*cc->hist));
+		if (!cc->hist)
 			die_out_of_memory();
 	}
-	cc = &counts[scno];
+	cc->hist[hist_index(ns)]++;
+	if (ns > cc->max)
+		cc->max = ns;
+}
 
+static void
+count_call(struct call_counts *cc, struct tcb *tcp, uint64_t time, uint64_t wall)
+{
 	cc->calls++;
 	if (tcp->u_error)
 		cc->errors++;
+	cc->time += time;
+	if (latency_mode)
+		count_latency(cc, wall);
+}
+
+static struct call_counts *
+alloc_counts(unsigned int n)
+{
+	struct call_counts *cnt = calloc(n, sizeof(*cnt));
+
+	if (!cnt)
+		die_out_of_memory();
+	return cnt;
+}
+
+static void
+read_comm(struct proc_counts *pc, int pid)
+{
+	char path[sizeof("/proc/%u/comm") + sizeof(int)*3];
+	ssize_t n;
+	int fd;
+
+	sprintf(path, "/proc/%u/comm", pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return;
+	n = read(fd, pc->comm, sizeof(pc->comm) - 1);
+	close(fd);
+	if (n <= 0)
+		return;
+	if (pc->comm[n - 1] == '\n')
+		n--;
+	pc->comm[n] = '\0';
+}
+
+/*
+ * Return the stats of tcp's process or thread, creating them
+ * if needed.  Threads find their process by the tgid among the live ones,
+ * so that a reused pid starts anew.
+ */
+static struct proc_counts *
+attach_proc_counts(struct tcb *tcp)
+{
+	struct proc_counts *pc = NULL;
+	int pid = tcp->pid;
+
+	if (tcp->proc_counts)
+		return tcp->proc_counts;
+	if (summary_by == SUMMARY_BY_PROCESS) {
+		int nthreads;
+
+		pid = read_tgid(tcp->pid, &nthreads);
+		if (pid < 0)
+			pid = tcp->pid;
+		for (pc = proc_list; pc; pc = pc->next)
+			if (pc->pid == pid && pc->refcnt)
+				break;
+	}
+	if (!pc) {
+		pc = calloc(1, sizeof(*pc));
+		if (!pc)
+			die_out_of_memory();
+		pc->pid = pid;
+		read_comm(pc, pid);
+		pc->next = proc_list;
+		proc_list = pc;
+		nproc_counts++;
+	}
+	pc->refcnt++;
+	pc->threads++;
+	tcp->proc_counts = pc;
+	return pc;
+}
+
+/* Store the operation of a multiplexed syscall in `op' */
+static bool
+syscall_op(struct tcb *tcp, unsigned long *op)
+{
+	int (*func)() = tcp->s_ent->sys_func;
+
+	if (func == sys_ioctl || func == sys_fcntl || func == sys_futex)
+		*op = (unsigned int) tcp->u_arg[1];
+	else if (func == sys_keyctl
+#ifdef HAVE_PRCTL
+		 || func == sys_prctl
+#endif
+		)
+		*op = (unsigned int) tcp->u_arg[0];
+	else
+		return false;
+	return true;
+}
+
+static unsigned int
+op_hash(unsigned long op)
+{
+	return (unsigned int) (op ^ (op >> 16)) * 0x9e3779b1U;
+}
 
-	/* tv = wall clock time spent while in syscall */
-	tv_sub(tv, tv, &tcp->etime);
+static void
+grow_op_table(struct op_table *oc)
+{
+	unsigned int i, j, size = oc->size ? oc->size * 2 : 16;
+	struct op_entry *tab = calloc(size, sizeof(*tab));
 
-	/* Spent more wall clock time than spent system time? (usually yes) */
-	if (tv_cmp(tv, &tcp->dtime) > 0) {
-		static struct timeval one_tick = { -1, 0 };
+	if (!tab)
+		die_out_of_memory();
+	for (i = 0; i < oc->size; i++) {
+		if (!oc->tab[i].cc.calls)
+			continue;
+		j = op_hash(oc->tab[i].op) & (size - 1);
+		while (tab[j].cc.calls)
+			j = (j + 1) & (size - 1);
+		tab[j] = oc->tab[i];
+	}
+	free(oc->tab);
+	oc->tab = tab;
+	oc->size = size;
+}
+
+/* Return the stats of `op', a new entry is counted by the caller */
+static struct call_counts *
+lookup_op(struct op_table *oc, unsigned long op)
+{
+	unsigned int i;
 
-		if (one_tick.tv_sec == -1) {
-			/* Initialize it.  */
-			struct itimerval it;
+	if (oc->used * 2 >= oc->size)
+		grow_op_table(oc);
+	for (i = op_hash(op) & (oc->size - 1); ; i = (i + 1) & (oc->size - 1)) {
+		struct op_entry *e = &oc->tab[i];
 
-			memset(&it, 0, sizeof it);
-			it.it_interval.tv_usec = 1;
-			setitimer(ITIMER_REAL, &it, NULL);
-			getitimer(ITIMER_REAL, &it);
-			one_tick = it.it_interval;
-//FIXME: this hack doesn't work (tested on linux-3.6.11): one_tick = 0.000000
-//tprintf(" one_tick.tv_usec:%u\n", (unsigned)one_tick.tv_usec);
+		if (!e->cc.calls) {
+			e->op = op;
+			oc->used++;
+			return &e->cc;
 		}
+		if (e->op == op)
+			return &e->cc;
+	}
+}
 
-		if (tv_nz(&tcp->dtime))
-			/* tv = system time spent, if it isn't 0 */
-			*tv = tcp->dtime;
-		else if (tv_cmp(tv, &one_tick) > 0) {
-			/* tv = smallest "sane" time interval */
-			if (tv_cmp(&shortest, &one_tick) < 0)
-				*tv = shortest;
-			else
-				*tv = one_tick;
+/* exit_ns is the syscall exit timestamp */
+void
+count_syscall(struct tcb *tcp, uint64_t exit_ns)
+{
+	uint64_t wall, time;
+	unsigned long scno = tcp->scno, op;
+
+	if (!SCNO_IN_RANGE(scno))
+		return;
+
+	if (!counts)
+		counts = alloc_counts(nsyscalls);
+
+	/* wall clock time spent while in syscall */
+	wall = exit_ns - tcp->etime;
+
+	/*
+	 * Unless -w, count the system time spent, if it is less (usually
+	 * yes).  It is updated in ticks, so it is often 0 for short calls.
+	 */
+	time = wall;
+	if (!count_wallclock && time > tcp->dtime)
+		time = tcp->dtime;
+	if (time < shortest)
+		shortest = time;
+	count_call(&counts[scno], tcp, time, wall);
+
+	if (tcp->s_ent->sys_func == sys_ioctl) {
+		if (!ioctl_counts)
+			ioctl_counts = alloc_counts(NIOCTL_TYPES);
+		count_call(&ioctl_counts[(tcp->u_arg[1] >> 8) & 0xff],
+			   tcp, time, wall);
+	}
+
+	if (syscall_op(tcp, &op)) {
+		if (!op_counts) {
+			op_counts = calloc(nsyscalls, sizeof(*op_counts));
+			if (!op_counts)
+				die_out_of_memory();
+		}
+		if (!op_counts[scno]) {
+			op_counts[scno] = calloc(1, sizeof(*op_counts[scno]));
+			if (!op_counts[scno])
+				die_out_of_memory();
 		}
+		count_call(lookup_op(op_counts[scno], op), tcp, time, wall);
+	}
+
+	if (summary_by) {
+		struct proc_counts *pc = attach_proc_counts(tcp);
+
+		if (!pc->countv[current_personality])
+			pc->countv[current_personality] = alloc_counts(nsyscalls);
+		count_call(&pc->countv[current_personality][scno],
+			   tcp, time, wall);
+		if (tcp->s_ent->sys_func == sys_execve && !tcp->u_error)
+			read_comm(pc, tcp->pid);
 	}
-	if (tv_cmp(tv, &shortest) < 0)
-		shortest = *tv;
-	tv_add(&cc->time, &cc->time, tv);
 }
 
+/* Stats being sorted: counts or ioctl_counts */
+static struct call_counts *sort_counts;
+
 static int
 time_cmp(void *a, void *b)
 {
-	return -tv_cmp(&counts[*((int *) a)].time,
-		       &counts[*((int *) b)].time);
+	uint64_t m = sort_counts[*((int *) a)].time;
+	uint64_t n = sort_counts[*((int *) b)].time;
+
+	return (m < n) ? 1 : (m > n) ? -1 : 0;
 }
 
 static int
@@ -121,14 +390,15 @@ syscall_cmp(void *a, void *b)
 static int
 count_cmp(void *a, void *b)
 {
-	int     m = counts[*((int *) a)].calls;
-	int     n = counts[*((int *) b)].calls;
+	int     m = sort_counts[*((int *) a)].calls;
+	int     n = sort_counts[*((int *) b)].calls;
 
 	return (m < n) ? 1 : (m > n) ? -1 : 0;
 }
 
 static int (*sortfun)();
-static struct timeval overhead = { -1, -1 };
+/* ns, -1 until set by -O or estimated from the shortest call */
+static int64_t overhead = -1;
 
 void
 set_sortby(const char *sortby)
@@ -148,89 +418,540 @@ set_sortby(const char *sortby)
 
 void set_overhead(int n)
 {
-	overhead.tv_sec = n / 1000000;
-	overhead.tv_usec = n % 1000000;
+	overhead = n * 1000LL;
+}
+
+/* The overhead estimate is not final until call_summary() */
+static uint64_t
+overhead_ns(void)
+{
+	return overhead >= 0 ? (uint64_t) overhead : shortest * 8 / 10;
+}
+
+/* Subtract the overhead of `calls' calls from `cc->time' */
+static void
+subtract_overhead(struct call_counts *cc)
+{
+	uint64_t total = overhead_ns() * cc->calls;
+
+	cc->time = cc->time > total ? cc->time - total : 0;
+}
+
+/* Latency in nsecs, with the overhead subtracted like from the total time */
+static uint64_t
+latency_nsecs(uint64_t ns)
+{
+	return ns > overhead_ns() ? ns - overhead_ns() : 0;
+}
+
+static const double percentiles[] = { 50, 90, 99, 99.9 };
+/* Enough for the percentile and max columns with any values */
+#define LATENCY_BUF_SIZE	((ARRAY_SIZE(percentiles) + 1) * 21 + 1)
+
+/* Print the percentile and max column headers into `buf' */
+static const char *
+latency_header(char *buf, const char *dashes)
+{
+	char *p = buf;
+	unsigned int i;
+
+	*p = '\0';
+	if (!latency_mode)
+		return buf;
+	for (i = 0; i < ARRAY_SIZE(percentiles); i++) {
+		char title[16];
+
+		sprintf(title, "p%g", percentiles[i]);
+		p += sprintf(p, "%9.9s ", dashes ? dashes : title);
+	}
+	sprintf(p, "%9.9s ", dashes ? dashes : "max");
+	return buf;
+}
+
+/*
+ * Print the percentiles and the max of the histogram into `buf'.
+ * A percentile is the highest value of the bucket it falls into,
+ * but not more than the max.
+ */
+static const char *
+latency_columns(char *buf, const unsigned int *hist, unsigned int calls,
+		uint64_t max)
+{
+	char *p = buf;
+	unsigned int i, b = 0;
+	uint64_t seen = 0;
+
+	*p = '\0';
+	if (!latency_mode)
+		return buf;
+	for (i = 0; i < ARRAY_SIZE(percentiles); i++) {
+		/* The number of calls at or below the percentile */
+		uint64_t rank = (uint64_t) (calls * percentiles[i] / 100 + 0.999999);
+
+		if (rank == 0)
+			rank = 1;
+		while (b < HIST_BUCKETS && seen + hist[b] < rank)
+			seen += hist[b++];
+		p += sprintf(p, "%9lu ", (unsigned long)
+			(latency_nsecs(b < HIST_BUCKETS && hist_high(b) < max
+				       ? hist_high(b) : max) / 1000));
+	}
+	sprintf(p, "%9lu ", (unsigned long) (latency_nsecs(max) / 1000));
+	return buf;
+}
+
+static void
+print_histogram(FILE *outf, const char *name, const struct call_counts *cc)
+{
+	unsigned int i;
+	unsigned long cum = 0;
+
+	fprintf(outf, "\n%s latency, usecs:\n", name);
+	fprintf(outf, "%12.12s %12.12s %9.9s %7.7s %7.7s\n",
+		"from", "to", "calls", "%", "cum %");
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		uint64_t high;
+
+		if (!cc->hist[i])
+			continue;
+		cum += cc->hist[i];
+		high = hist_high(i) < cc->max ? hist_high(i) : cc->max;
+		fprintf(outf, "%12.3f %12.3f %9u %7.2f %7.2f\n",
+			latency_nsecs(hist_low(i)) / 1000.0,
+			latency_nsecs(high) / 1000.0,
+			cc->hist[i], 100.0 * cc->hist[i] / cc->calls,
+			100.0 * cum / cc->calls);
+	}
 }
 
+/* Merge the histogram of `cc' into `total' */
 static void
-call_summary_pers(FILE *outf)
+add_latency(struct call_counts *total, const struct call_counts *cc)
+{
+	unsigned int i;
+
+	if (!cc->hist)
+		return;
+	for (i = 0; i < HIST_BUCKETS; i++)
+		total->hist[i] += cc->hist[i];
+	if (cc->max > total->max)
+		total->max = cc->max;
+}
+
+/* Up to this many bytes of ioctl names, like "FOO or BAR", in op_name() */
+#define OP_NAME_SIZE	128
+
+static const char *
+op_name(char *buf, int (*func)(), unsigned long op)
+{
+	const char *str = NULL;
+
+	if (func == sys_ioctl) {
+		const struct_ioctlent *iop = ioctl_lookup(op);
+		unsigned int len = 0;
+
+		/* All the names of the code, as the decoder prints them */
+		for (; iop; iop = ioctl_next_match(iop)) {
+			len += snprintf(buf + len, OP_NAME_SIZE - len, "%s%s",
+					len ? " or " : "", iop->symbol);
+			if (len >= OP_NAME_SIZE)
+				break;
+		}
+		if (len)
+			return buf;
+	} else if (func == sys_fcntl)
+		str = xlookup(fcntlcmds, op);
+	else if (func == sys_futex)
+		str = xlookup(futexops, op);
+	else if (func == sys_keyctl)
+		str = xlookup(keyctl_commands, op);
+#ifdef HAVE_PRCTL
+	else if (func == sys_prctl)
+		str = xlookup(prctl_options, op);
+#endif
+	if (str)
+		return str;
+	sprintf(buf, "%#lx", op);
+	return buf;
+}
+
+/* Like the sort of the syscalls, operations take the place of names */
+static int
+op_cmp(const void *a, const void *b)
+{
+	const struct op_entry *m = *(const struct op_entry **) a;
+	const struct op_entry *n = *(const struct op_entry **) b;
+
+	if (sortfun == time_cmp && m->cc.time != n->cc.time)
+		return m->cc.time < n->cc.time ? 1 : -1;
+	if (sortfun == count_cmp && m->cc.calls != n->cc.calls)
+		return m->cc.calls < n->cc.calls ? 1 : -1;
+	return m->op < n->op ? -1 : m->op > n->op;
+}
+
+/* Print the rows of the operations of syscall `idx' below its row */
+static void
+op_summary_pers(FILE *outf, struct op_table *oc, int idx,
+		double float_time_cum)
+{
+	char    error_str[sizeof(int)*3];
+	char    op_str[OP_NAME_SIZE];
+	char    latency_str[LATENCY_BUF_SIZE];
+	struct op_entry **sorted;
+	unsigned int i, n = 0;
+
+	sorted = malloc(oc->used * sizeof(*sorted));
+	if (!sorted)
+		die_out_of_memory();
+	for (i = 0; i < oc->size; i++) {
+		if (!oc->tab[i].cc.calls)
+			continue;
+		subtract_overhead(&oc->tab[i].cc);
+		sorted[n++] = &oc->tab[i];
+	}
+	qsort(sorted, n, sizeof(*sorted), op_cmp);
+	for (i = 0; i < n; i++) {
+		struct call_counts *cc = &sorted[i]->cc;
+		double percent = 100.0 * cc->time / 1e9;
+
+		if (percent != 0.0)
+			percent /= float_time_cum;
+		error_str[0] = '\0';
+		if (cc->errors)
+			sprintf(error_str, "%u", cc->errors);
+		fprintf(outf, "%6.2f %11.6f %11lu %9u %9.9s %s  %s\n",
+			percent, cc->time / 1e9,
+			(unsigned long) ((cc->time / cc->calls + 500) / 1000),
+			cc->calls, error_str,
+			latency_columns(latency_str, cc->hist,
+					cc->calls, cc->max),
+			op_name(op_str, sysent[idx].sys_func, sorted[i]->op));
+	}
+	free(sorted);
+}
+
+/* `ops' are the operations of multiplexed syscalls to print, or NULL */
+static void
+call_summary_pers(FILE *outf, struct call_counts *table,
+		  struct op_table **ops)
 {
 	int     i;
 	int     call_cum, error_cum;
-	struct timeval tv_cum, dtv;
-	double  float_tv_cum;
+	uint64_t time_cum;
+	double  float_time_cum;
 	double  percent;
 	const char *dashes = "----------------";
 	char    error_str[sizeof(int)*3];
+	char    latency_str[LATENCY_BUF_SIZE];
 	int    *sorted_count;
+	struct call_counts total = { .max = 0 };
 
-	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %s\n",
+	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %s%s\n",
 		"% time", "seconds", "usecs/call",
-		"calls", "errors", "syscall");
-	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %s\n",
-		dashes, dashes, dashes, dashes, dashes, dashes);
+		"calls", "errors", latency_header(latency_str, NULL), "syscall");
+	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %s%s\n",
+		dashes, dashes, dashes, dashes, dashes,
+		latency_header(latency_str, dashes), dashes);
 
 	sorted_count = calloc(sizeof(int), nsyscalls);
 	if (!sorted_count)
 		die_out_of_memory();
-	call_cum = error_cum = tv_cum.tv_sec = tv_cum.tv_usec = 0;
-	if (overhead.tv_sec == -1) {
-		tv_mul(&overhead, &shortest, 8);
-		tv_div(&overhead, &overhead, 10);
+	if (latency_mode) {
+		total.hist = calloc(HIST_BUCKETS, sizeof(*total.hist));
+		if (!total.hist)
+			die_out_of_memory();
 	}
+	call_cum = error_cum = 0;
+	time_cum = 0;
 	for (i = 0; i < nsyscalls; i++) {
 		sorted_count[i] = i;
-		if (counts == NULL || counts[i].calls == 0)
+		if (table == NULL || table[i].calls == 0)
 			continue;
-		tv_mul(&dtv, &overhead, counts[i].calls);
-		tv_sub(&counts[i].time, &counts[i].time, &dtv);
-		call_cum += counts[i].calls;
-		error_cum += counts[i].errors;
-		tv_add(&tv_cum, &tv_cum, &counts[i].time);
-	}
-	float_tv_cum = tv_float(&tv_cum);
-	if (counts) {
+		subtract_overhead(&table[i]);
+		call_cum += table[i].calls;
+		error_cum += table[i].errors;
+		time_cum += table[i].time;
+		if (latency_mode)
+			add_latency(&total, &table[i]);
+	}
+	float_time_cum = time_cum / 1e9;
+	if (table) {
+		sort_counts = table;
 		if (sortfun)
 			qsort((void *) sorted_count, nsyscalls, sizeof(int), sortfun);
 		for (i = 0; i < nsyscalls; i++) {
 			double float_syscall_time;
 			int idx = sorted_count[i];
-			struct call_counts *cc = &counts[idx];
+			struct call_counts *cc = &table[idx];
 			if (cc->calls == 0)
 				continue;
-			tv_div(&dtv, &cc->time, cc->calls);
 			error_str[0] = '\0';
 			if (cc->errors)
 				sprintf(error_str, "%u", cc->errors);
-			float_syscall_time = tv_float(&cc->time);
+			float_syscall_time = cc->time / 1e9;
 			percent = (100.0 * float_syscall_time);
 			if (percent != 0.0)
-				   percent /= float_tv_cum;
-			/* else: float_tv_cum can be 0.0 too and we get 0/0 = NAN */
-			fprintf(outf, "%6.2f %11.6f %11lu %9u %9.9s %s\n",
+				   percent /= float_time_cum;
+			/* else: float_time_cum can be 0.0 too and we get 0/0 = NAN */
+			fprintf(outf, "%6.2f %11.6f %11lu %9u %9.9s %s%s\n",
 				percent, float_syscall_time,
-				(long) (1000000 * dtv.tv_sec + dtv.tv_usec),
-				cc->calls,
-				error_str, sysent[idx].sys_name);
+				(unsigned long) ((cc->time / cc->calls + 500) / 1000),
+				cc->calls, error_str,
+				latency_columns(latency_str, cc->hist,
+						cc->calls, cc->max),
+				sysent[idx].sys_name);
+			if (ops && ops[idx])
+				op_summary_pers(outf, ops[idx], idx,
+						float_time_cum);
 		}
 	}
+
+	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %s%s\n",
+		dashes, dashes, dashes, dashes, dashes,
+		latency_header(latency_str, dashes), dashes);
+	error_str[0] = '\0';
+	if (error_cum)
+		sprintf(error_str, "%u", error_cum);
+	fprintf(outf, "%6.6s %11.6f %11.11s %9u %9.9s %s%s\n",
+		"100.00", float_time_cum, "",
+		call_cum, error_str,
+		latency_columns(latency_str, total.hist, call_cum, total.max),
+		"total");
+
+	if (latency_mode == LATENCY_HISTOGRAM && table) {
+		for (i = 0; i < nsyscalls; i++) {
+			int idx = sorted_count[i];
+
+			if (table[idx].calls)
+				print_histogram(outf, sysent[idx].sys_name,
+						&table[idx]);
+		}
+	}
+	free(total.hist);
 	free(sorted_count);
+}
 
-	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %s\n",
-		dashes, dashes, dashes, dashes, dashes, dashes);
+static void
+ioctl_type_str(char *buf, int type)
+{
+	if (type > ' ' && type < 0x7f && type != '\'' && type != '\\')
+		sprintf(buf, "'%c'", type);
+	else
+		sprintf(buf, "%#04x", type);
+}
+
+static void
+ioctl_summary_pers(FILE *outf)
+{
+	int     i;
+	int     call_cum, error_cum;
+	uint64_t time_cum;
+	double  float_time_cum;
+	double  percent;
+	const char *dashes = "----------------";
+	char    error_str[sizeof(int)*3];
+	char    type_str[sizeof("0x00")];
+	char    latency_str[LATENCY_BUF_SIZE];
+	int     sorted_count[NIOCTL_TYPES];
+	struct call_counts total = { .max = 0 };
+
+	fprintf(outf, "\n%6.6s %11.11s %11.11s %9.9s %9.9s %s%s\n",
+		"% time", "seconds", "usecs/call",
+		"calls", "errors", latency_header(latency_str, NULL),
+		"ioctl type");
+	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %s%s\n",
+		dashes, dashes, dashes, dashes, dashes,
+		latency_header(latency_str, dashes), dashes);
+
+	if (latency_mode) {
+		total.hist = calloc(HIST_BUCKETS, sizeof(*total.hist));
+		if (!total.hist)
+			die_out_of_memory();
+	}
+	call_cum = error_cum = 0;
+	time_cum = 0;
+	for (i = 0; i < NIOCTL_TYPES; i++) {
+		sorted_count[i] = i;
+		if (ioctl_counts[i].calls == 0)
+			continue;
+		subtract_overhead(&ioctl_counts[i]);
+		call_cum += ioctl_counts[i].calls;
+		error_cum += ioctl_counts[i].errors;
+		time_cum += ioctl_counts[i].time;
+		if (latency_mode)
+			add_latency(&total, &ioctl_counts[i]);
+	}
+	float_time_cum = time_cum / 1e9;
+	sort_counts = ioctl_counts;
+	/* Types are already in the order of their names */
+	if (sortfun && sortfun != syscall_cmp)
+		qsort((void *) sorted_count, NIOCTL_TYPES, sizeof(int), sortfun);
+	for (i = 0; i < NIOCTL_TYPES; i++) {
+		double float_type_time;
+		int type = sorted_count[i];
+		struct call_counts *cc = &ioctl_counts[type];
+		if (cc->calls == 0)
+			continue;
+		error_str[0] = '\0';
+		if (cc->errors)
+			sprintf(error_str, "%u", cc->errors);
+		ioctl_type_str(type_str, type);
+		float_type_time = cc->time / 1e9;
+		percent = (100.0 * float_type_time);
+		if (percent != 0.0)
+			   percent /= float_time_cum;
+		fprintf(outf, "%6.2f %11.6f %11lu %9u %9.9s %s%s\n",
+			percent, float_type_time,
+			(unsigned long) ((cc->time / cc->calls + 500) / 1000),
+			cc->calls, error_str,
+			latency_columns(latency_str, cc->hist,
+					cc->calls, cc->max),
+			type_str);
+	}
+
+	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %s%s\n",
+		dashes, dashes, dashes, dashes, dashes,
+		latency_header(latency_str, dashes), dashes);
 	error_str[0] = '\0';
 	if (error_cum)
 		sprintf(error_str, "%u", error_cum);
-	fprintf(outf, "%6.6s %11.6f %11.11s %9u %9.9s %s\n",
-		"100.00", float_tv_cum, "",
-		call_cum, error_str, "total");
+	fprintf(outf, "%6.6s %11.6f %11.11s %9u %9.9s %s%s\n",
+		"100.00", float_time_cum, "",
+		call_cum, error_str,
+		latency_columns(latency_str, total.hist, call_cum, total.max),
+		"total");
+
+	if (latency_mode == LATENCY_HISTOGRAM) {
+		for (i = 0; i < NIOCTL_TYPES; i++) {
+			int type = sorted_count[i];
+			char name[sizeof("ioctl type 0x00")];
+
+			if (!ioctl_counts[type].calls)
+				continue;
+			ioctl_type_str(type_str, type);
+			sprintf(name, "ioctl type %s", type_str);
+			print_histogram(outf, name, &ioctl_counts[type]);
+		}
+	}
+	free(total.hist);
 }
 
+/* Counts as of the previous --interval summary */
+static struct call_counts *prev_countv[SUPPORTED_PERSONALITIES];
+#define prev_counts (prev_countv[current_personality])
+
+static void
+interval_summary_pers(FILE *outf, double seconds)
+{
+	int     i;
+	int     call_cum, error_cum;
+	uint64_t time_cum, ovh;
+	double  float_time_cum;
+	double  percent;
+	const char *dashes = "----------------";
+	char    error_str[sizeof(int)*3];
+	char    error_rate_str[sizeof("100.00")];
+	int    *sorted_count;
+	struct call_counts *delta;
+
+	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %9.9s %s\n",
+		"% time", "seconds", "calls/s",
+		"calls", "errors", "% errors", "syscall");
+	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %9.9s %s\n",
+		dashes, dashes, dashes, dashes, dashes, dashes, dashes);
+
+	if (!prev_counts) {
+		prev_counts = calloc(nsyscalls, sizeof(*prev_counts));
+		if (!prev_counts)
+			die_out_of_memory();
+	}
+	sorted_count = calloc(sizeof(int), nsyscalls);
+	delta = calloc(nsyscalls, sizeof(*delta));
+	if (!sorted_count || !delta)
+		die_out_of_memory();
+	ovh = overhead_ns();
+	call_cum = error_cum = 0;
+	time_cum = 0;
+	for (i = 0; i < nsyscalls; i++) {
+		sorted_count[i] = i;
+		delta[i].calls = counts[i].calls - prev_counts[i].calls;
+		delta[i].errors = counts[i].errors - prev_counts[i].errors;
+		delta[i].time = counts[i].time - prev_counts[i].time;
+		prev_counts[i].calls = counts[i].calls;
+		prev_counts[i].errors = counts[i].errors;
+		prev_counts[i].time = counts[i].time;
+		if (delta[i].time > ovh * delta[i].calls)
+			delta[i].time -= ovh * delta[i].calls;
+		else
+			delta[i].time = 0;
+		call_cum += delta[i].calls;
+		error_cum += delta[i].errors;
+		time_cum += delta[i].time;
+	}
+	float_time_cum = time_cum / 1e9;
+	sort_counts = delta;
+	if (sortfun)
+		qsort((void *) sorted_count, nsyscalls, sizeof(int), sortfun);
+	for (i = 0; i < nsyscalls; i++) {
+		int idx = sorted_count[i];
+		struct call_counts *cc = &delta[idx];
+
+		if (cc->calls == 0)
+			continue;
+		error_str[0] = error_rate_str[0] = '\0';
+		if (cc->errors) {
+			sprintf(error_str, "%u", cc->errors);
+			sprintf(error_rate_str, "%.2f",
+				100.0 * cc->errors / cc->calls);
+		}
+		percent = 100.0 * cc->time / 1e9;
+		if (percent != 0.0)
+			percent /= float_time_cum;
+		fprintf(outf, "%6.2f %11.6f %11.1f %9u %9.9s %9.9s %s\n",
+			percent, cc->time / 1e9, cc->calls / seconds,
+			cc->calls, error_str, error_rate_str,
+			sysent[idx].sys_name);
+	}
+	free(delta);
+	free(sorted_count);
+
+	fprintf(outf, "%6.6s %11.11s %11.11s %9.9s %9.9s %9.9s %s\n",
+		dashes, dashes, dashes, dashes, dashes, dashes, dashes);
+	error_str[0] = error_rate_str[0] = '\0';
+	if (error_cum) {
+		sprintf(error_str, "%u", error_cum);
+		sprintf(error_rate_str, "%.2f", 100.0 * error_cum / call_cum);
+	}
+	fprintf(outf, "%6.6s %11.6f %11.1f %9u %9.9s %9.9s %s\n",
+		"100.00", float_time_cum, call_cum / seconds,
+		call_cum, error_str, error_rate_str, "total");
+}
+
+/* Whether any syscall has been counted yet */
+bool
+have_counts(void)
+{
+	int i;
+
+	for (i = 0; i < SUPPORTED_PERSONALITIES; ++i)
+		if (countv[i])
+			return 1;
+	return 0;
+}
+
+/*
+ * --interval: print what was counted since the previous call,
+ * `elapsed_ns' ago.  Nothing is printed until something is counted.
+ */
 void
-call_summary(FILE *outf)
+interval_summary(FILE *outf, uint64_t elapsed_ns)
 {
 	int i, old_pers = current_personality;
+	double seconds = elapsed_ns ? elapsed_ns / 1e9 : 1e-9;
 
+	if (!have_counts())
+		return;
+	fprintf(outf, "--- %.3f seconds ---\n", seconds);
 	for (i = 0; i < SUPPORTED_PERSONALITIES; ++i) {
 		if (!countv[i])
 			continue;
@@ -241,9 +962,218 @@ call_summary(FILE *outf)
 			fprintf(outf,
 				"System call usage summary for %d bit mode:\n",
 				current_wordsize * 8);
-		call_summary_pers(outf);
+		interval_summary_pers(outf, seconds);
+	}
+	fputc('\n', outf);
+	fflush(outf);
+
+	if (old_pers != current_personality)
+		set_personality(old_pers);
+}
+
+/*
+ * Print the tables of `cv', with `details' also the breakdowns
+ * of ioctl_countv and op_countv.
+ */
+static void
+print_summary(FILE *outf, struct call_counts **cv, bool details)
+{
+	int i, old_pers = current_personality;
+
+	for (i = 0; i < SUPPORTED_PERSONALITIES; ++i) {
+		if (!cv[i])
+			continue;
+
+		if (current_personality != i)
+			set_personality(i);
+		if (i)
+			fprintf(outf,
+				"System call usage summary for %d bit mode:\n",
+				current_wordsize * 8);
+		call_summary_pers(outf, cv[i], details ? op_counts : NULL);
+		if (details && ioctl_counts)
+			ioctl_summary_pers(outf);
+	}
+
+	if (old_pers != current_personality)
+		set_personality(old_pers);
+}
+
+/* Set the totals of `pc' from its tables, without changing them */
+static void
+proc_totals(struct proc_counts *pc)
+{
+	int i, old_pers = current_personality;
+	unsigned int j;
+
+	pc->time = 0;
+	pc->calls = pc->errors = 0;
+	for (i = 0; i < SUPPORTED_PERSONALITIES; ++i) {
+		if (!pc->countv[i])
+			continue;
+
+		if (current_personality != i)
+			set_personality(i);
+		for (j = 0; j < nsyscalls; j++) {
+			struct call_counts cc = pc->countv[i][j];
+
+			if (!cc.calls)
+				continue;
+			subtract_overhead(&cc);
+			pc->time += cc.time;
+			pc->calls += cc.calls;
+			pc->errors += cc.errors;
+		}
 	}
 
 	if (old_pers != current_personality)
 		set_personality(old_pers);
 }
+
+static void
+free_proc_tables(struct proc_counts *pc)
+{
+	int i, old_pers = current_personality;
+	unsigned int j;
+
+	for (i = 0; i < SUPPORTED_PERSONALITIES; ++i) {
+		if (!pc->countv[i])
+			continue;
+
+		if (current_personality != i)
+			set_personality(i);
+		for (j = 0; j < nsyscalls; j++)
+			free(pc->countv[i][j].hist);
+		free(pc->countv[i]);
+		pc->countv[i] = NULL;
+	}
+
+	if (old_pers != current_personality)
+		set_personality(old_pers);
+}
+
+static void
+print_proc_summary(FILE *outf, struct proc_counts *pc)
+{
+	fprintf(outf, "%s %d (%s)",
+		summary_by == SUMMARY_BY_THREAD ? "Thread" : "Process",
+		pc->pid, pc->comm);
+	if (summary_by == SUMMARY_BY_PROCESS && pc->threads > 1)
+		fprintf(outf, ", %u threads", pc->threads);
+	fprintf(outf, ":\n");
+	print_summary(outf, pc->countv, false);
+}
+
+/*
+ * The stats of tcp's process or thread are complete when its last tcb
+ * is dropped.  With -ff, print them to its file and keep only the totals.
+ * Unless -O is given, the overhead estimate is not final yet, both use
+ * the estimate as of now.
+ */
+void
+count_release(struct tcb *tcp)
+{
+	struct proc_counts *pc = tcp->proc_counts;
+
+	if (!pc || --pc->refcnt)
+		return;
+	if (followfork >= 2 && tcp->outf) {
+		/* Before printing, which subtracts the overhead in place */
+		proc_totals(pc);
+		print_proc_summary(tcp->outf, pc);
+		free_proc_tables(pc);
+	}
+}
+
+static int
+proc_time_cmp(const void *a, const void *b)
+{
+	const struct proc_counts *m = *(const struct proc_counts **) a;
+	const struct proc_counts *n = *(const struct proc_counts **) b;
+
+	if (m->time != n->time)
+		return m->time < n->time ? 1 : -1;
+	if (m->calls != n->calls)
+		return m->calls < n->calls ? 1 : -1;
+	return m->pid - n->pid;
+}
+
+/*
+ * --summary-by: list the summary_top processes or threads with the most
+ * time in syscalls, then print their own tables unless -ff did.
+ */
+static void
+proc_summary(FILE *outf)
+{
+	const char *dashes = "----------------";
+	const char *what = summary_by == SUMMARY_BY_THREAD ? "thread" : "process";
+	char error_str[sizeof(int)*3];
+	struct proc_counts **sorted, *pc;
+	unsigned int i, shown, call_cum = 0, error_cum = 0;
+	uint64_t time_cum = 0;
+
+	if (!nproc_counts)
+		return;
+	sorted = malloc(nproc_counts * sizeof(*sorted));
+	if (!sorted)
+		die_out_of_memory();
+	for (i = 0, pc = proc_list; pc; pc = pc->next, i++) {
+		if (followfork < 2)
+			proc_totals(pc);
+		sorted[i] = pc;
+		time_cum += pc->time;
+		call_cum += pc->calls;
+		error_cum += pc->errors;
+	}
+	qsort(sorted, nproc_counts, sizeof(*sorted), proc_time_cmp);
+	shown = summary_top && summary_top < nproc_counts
+		? summary_top : nproc_counts;
+
+	fprintf(outf, "\n%6.6s %11.11s %9.9s %9.9s %9.9s %s\n",
+		"% time", "seconds", "calls", "errors",
+		summary_by == SUMMARY_BY_THREAD ? "tid" : "pid", what);
+	fprintf(outf, "%6.6s %11.11s %9.9s %9.9s %9.9s %s\n",
+		dashes, dashes, dashes, dashes, dashes, dashes);
+	for (i = 0; i < shown; i++) {
+		double percent;
+
+		pc = sorted[i];
+		error_str[0] = '\0';
+		if (pc->errors)
+			sprintf(error_str, "%u", pc->errors);
+		percent = 100.0 * pc->time;
+		if (percent != 0.0)
+			percent /= time_cum;
+		fprintf(outf, "%6.2f %11.6f %9u %9.9s %9d %s\n",
+			percent, pc->time / 1e9, pc->calls, error_str,
+			pc->pid, pc->comm);
+	}
+	if (shown < nproc_counts)
+		fprintf(outf, "%6.6s %11.11s %9.9s %9.9s %9.9s (%u more)\n",
+			"", "", "", "", "", nproc_counts - shown);
+	fprintf(outf, "%6.6s %11.11s %9.9s %9.9s %9.9s %s\n",
+		dashes, dashes, dashes, dashes, dashes, dashes);
+	error_str[0] = '\0';
+	if (error_cum)
+		sprintf(error_str, "%u", error_cum);
+	fprintf(outf, "%6.6s %11.6f %9u %9.9s %9.9s %s\n",
+		"100.00", time_cum / 1e9, call_cum, error_str, "", "total");
+
+	if (followfork < 2) {
+		for (i = 0; i < shown; i++) {
+			fputc('\n', outf);
+			print_proc_summary(outf, sorted[i]);
+		}
+	}
+	free(sorted);
+}
+
+void
+call_summary(FILE *outf)
+{
+	/* Freeze the overhead estimate for all the tables */
+	overhead = overhead_ns();
+	print_summary(outf, countv, true);
+	if (summary_by)
+		proc_summary(outf);
+}
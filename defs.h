@@ -189,6 +189,9 @@ extern long ptrace(int, int, char *, long);
 #if !HAVE_DECL_PTRACE_GETSIGINFO
 # define PTRACE_GETSIGINFO	0x4202
 #endif
+#if !HAVE_DECL_PTRACE_GET_SYSCALL_INFO
+# define PTRACE_GET_SYSCALL_INFO	0x420e
+#endif
 
 #if !HAVE_DECL_PTRACE_O_TRACESYSGOOD
 # define PTRACE_O_TRACESYSGOOD	0x00000001
@@ -208,6 +211,9 @@ extern long ptrace(int, int, char *, long);
 #if !HAVE_DECL_PTRACE_O_TRACEEXIT
 # define PTRACE_O_TRACEEXIT	0x00000040
 #endif
+#if !HAVE_DECL_PTRACE_O_TRACESECCOMP
+# define PTRACE_O_TRACESECCOMP	0x00000080
+#endif
 
 #if !HAVE_DECL_PTRACE_EVENT_FORK
 # define PTRACE_EVENT_FORK	1
@@ -227,6 +233,9 @@ extern long ptrace(int, int, char *, long);
 #if !HAVE_DECL_PTRACE_EVENT_EXIT
 # define PTRACE_EVENT_EXIT	6
 #endif
+#if !HAVE_DECL_PTRACE_EVENT_SECCOMP
+# define PTRACE_EVENT_SECCOMP	7
+#endif
 
 #if !HAVE_DECL_PTRACE_PEEKUSER
 # define PTRACE_PEEKUSER PTRACE_PEEKUSR
@@ -418,13 +427,19 @@ struct tcb {
 #endif
 	int curcol;		/* Output column for this process */
 	FILE *outf;		/* Output file for this process */
+	char *linebuf;		/* Line being assembled, curcol bytes long */
+	unsigned int linebuf_size;
 	const char *auxstr;	/* Auxiliary info from syscall (see RVAL_STR) */
 	const struct_sysent *s_ent; /* sysent[scno] or dummy struct for bad scno */
-	struct timeval stime;	/* System time usage as of last process wait */
-	struct timeval dtime;	/* Delta for system time usage */
-	struct timeval etime;	/* Syscall entry time */
+	uint64_t stime;		/* System time usage as of last process wait, ns */
+	uint64_t dtime;		/* Delta for system time usage, ns */
+	uint64_t etime;		/* Syscall entry time, CLOCK_MONOTONIC ns */
 				/* Support for tracing forked processes: */
 	long inst[2];		/* Saved clone args (badly named) */
+	int mem_fd;		/* /proc/PID/mem, -1 if not open */
+	struct fdcache *fdcache; /* Paths of fds, shared by threads */
+	struct proc_counts *proc_counts; /* -c stats of its process or thread */
+	struct tcb *next;	/* Next tcb in pid hash chain or free list */
 };
 
 /* TCB flags */
@@ -454,6 +469,8 @@ struct tcb {
 #define TCB_BPTSET	0x10	/* "Breakpoint" set after fork(2) */
 #define TCB_REPRINT	0x20	/* We should reprint this syscall on exit */
 #define TCB_FILTERED	0x40	/* This system call has been filtered out */
+#define TCB_NO_VM_READV	0x100	/* process_vm_readv is refused for this tracee */
+#define TCB_NO_PROC_MEM	0x200	/* /proc/PID/mem cannot be opened */
 /*
  * x86 does not need TCB_WAITEXECVE.
  * It can detect post-execve SIGTRAP by looking at eax/rax.
@@ -511,6 +528,10 @@ extern const struct xlat addrfams[];
 extern const struct xlat struct_user_offsets[];
 extern const struct xlat open_access_modes[];
 extern const struct xlat whence_codes[];
+extern const struct xlat fcntlcmds[];
+extern const struct xlat futexops[];
+extern const struct xlat prctl_options[];
+extern const struct xlat keyctl_commands[];
 
 /* Format of syscall return values */
 #define RVAL_DECIMAL	000	/* decimal format */
@@ -545,6 +566,22 @@ typedef enum {
 	CFLAG_BOTH
 } cflag_t;
 extern cflag_t cflag;
+/* --latency modes */
+enum {
+	LATENCY_NONE,
+	LATENCY_PERCENTILES,
+	LATENCY_HISTOGRAM	/* also print the histograms */
+};
+extern int latency_mode;
+/* --summary-by modes */
+enum {
+	SUMMARY_BY_NONE,
+	SUMMARY_BY_PROCESS,
+	SUMMARY_BY_THREAD
+};
+extern int summary_by;
+extern unsigned int summary_top;
+extern bool count_wallclock;
 extern bool debug_flag;
 extern bool Tflag;
 extern bool iflag;
@@ -552,14 +589,18 @@ extern unsigned int qflag;
 extern bool not_failing_only;
 extern bool show_fd_path;
 extern bool hide_log_until_execve;
+extern bool assemble_lines;
 /* are we filtering traces based on paths? */
-extern const char **paths_selected;
-#define tracing_paths (paths_selected != NULL)
+extern bool tracing_paths;
 extern bool need_fork_exec_workarounds;
+extern bool seccomp_filtering;
+extern bool use_syscall_info;
+extern unsigned ntracers;
 extern unsigned xflag;
 extern unsigned followfork;
 extern unsigned ptrace_setoptions;
 extern unsigned max_strlen;
+extern unsigned long dump_limit;
 extern unsigned os_release;
 #undef KERNEL_VERSION
 #define KERNEL_VERSION(a,b,c) (((a) << 16) + ((b) << 8) + (c))
@@ -586,9 +627,13 @@ extern void set_sortby(const char *);
 extern void set_overhead(int);
 extern void qualify(const char *);
 extern void print_pc(struct tcb *);
+extern void init_syscall_info(void);
 extern int trace_syscall(struct tcb *);
-extern void count_syscall(struct tcb *, struct timeval *);
+extern void count_syscall(struct tcb *, uint64_t);
+extern void count_release(struct tcb *);
 extern void call_summary(FILE *);
+extern bool have_counts(void);
+extern void interval_summary(FILE *, uint64_t);
 
 #if defined(AVR32) \
  || defined(I386) \
@@ -613,6 +658,23 @@ extern int umoven(struct tcb *, long, int, char *);
 #define umove(pid, addr, objp)	\
 	umoven((pid), (addr), sizeof(*(objp)), (char *) (objp))
 extern int umovestr(struct tcb *, long, int, char *);
+/* A range of tracee memory for umoven_multi */
+struct umove_req {
+	long addr;
+	unsigned int len;
+	void *laddr;
+	int rc;		/* result, as umoven would return it */
+};
+extern unsigned int umoven_multi(struct tcb *, struct umove_req *, unsigned int);
+extern unsigned int umove_array(struct tcb *, long, unsigned int, unsigned int, void *);
+extern void release_mem_fd(struct tcb *);
+extern void umove_cache_invalidate(void);
+extern void umove_cache_stats(void);
+extern void *arena_alloc(size_t);
+extern void *arena_mark(void);
+extern void arena_release(void *);
+extern void arena_reset(void);
+extern void arena_stats(void);
 extern int upeek(int pid, long, long *);
 #if defined(SPARC) || defined(SPARC64) || defined(IA64) || defined(SH)
 extern long getrval2(struct tcb *);
@@ -629,7 +691,69 @@ extern int clearbpt(struct tcb *);
 extern const char *signame(int);
 extern void pathtrace_select(const char *);
 extern int pathtrace_match(struct tcb *);
+extern const char *syscall_arg_roles(struct tcb *);
 extern int getfdpath(struct tcb *, int, char *, unsigned);
+extern int readfdpath(int, int, char *, unsigned);
+
+/* --fd-cache modes */
+enum {
+	FDCACHE_OFF,
+	FDCACHE_ON,
+	FDCACHE_CHECK	/* compare cached paths with /proc */
+};
+extern int fdcache_mode;
+extern bool fdcache_enabled;
+extern int fdcache_getpath(struct tcb *, int, char *, unsigned);
+extern int fdcache_getcwd(struct tcb *, char *, unsigned);
+extern void fdcache_syscall_exit(struct tcb *);
+extern bool fdcache_needs_scno(unsigned int);
+extern void fdcache_release(struct tcb *);
+extern int read_tgid(int, int *);
+extern void fdcache_stats(void);
+
+extern void init_seccomp_filter(void);
+extern void apply_seccomp_filter(void);
+
+/* What to do when --output-buffer is full */
+enum {
+	OUTPUT_OVERFLOW_BLOCK,	/* wait for the writer */
+	OUTPUT_OVERFLOW_DROP,	/* drop output */
+	OUTPUT_OVERFLOW_COUNT	/* drop output, note number of lost lines in the log */
+};
+extern void async_output_init(unsigned long size, int policy);
+extern FILE *async_output_wrap(FILE *);
+extern void async_output_start(void);
+extern void async_output_finish(void);
+
+/* Capture records, see capture.c */
+enum {
+	CAPTURE_ENTRY = 1,	/* syscall entry */
+	CAPTURE_EXIT,		/* syscall exit */
+	CAPTURE_SIGNAL,		/* signal-delivery-stop or group-stop */
+	CAPTURE_EXITED,		/* process exited */
+	CAPTURE_KILLED,		/* process was killed by a signal */
+	CAPTURE_EXECVE		/* execve in a thread replaced the leader */
+};
+#define CAPTURE_F_MULTI	1	/* several processes write to the log */
+extern bool capture_enabled;
+extern bool capture_decoding;
+extern void capture_start(FILE *, unsigned int flags);
+extern void capture_begin(struct tcb *, unsigned int type, long arg);
+extern void capture_end(struct tcb *);
+extern void capture_event(struct tcb *, unsigned int type, long arg);
+extern void capture_put_mem(long addr, int len, int ret, const char *laddr);
+extern void capture_put_str(long addr, int len, int ret, const char *laddr);
+extern void capture_put_fdpath(int fd, int ret, const char *path);
+extern void capture_put_siginfo(const siginfo_t *);
+extern unsigned int capture_open(const char *path);
+extern unsigned int capture_next(int *pid, long *arg);
+extern void capture_get_syscall(struct tcb *);
+extern void capture_gettime(struct timeval *);
+extern uint64_t capture_monotonic_ns(void);
+extern int capture_get_mem(long addr, int len, char *laddr);
+extern int capture_get_str(long addr, int len, char *laddr);
+extern int capture_get_fdpath(int fd, char *buf, unsigned bufsize);
+extern int capture_get_siginfo(siginfo_t *);
 
 extern const char *xlookup(const struct xlat *, int);
 
@@ -708,13 +832,8 @@ extern int ubi_ioctl(struct tcb *, long, long);
 extern int loop_ioctl(struct tcb *, long, long);
 extern int ptp_ioctl(struct tcb *, long, long);
 
-extern int tv_nz(struct timeval *);
-extern int tv_cmp(struct timeval *, struct timeval *);
-extern double tv_float(struct timeval *);
-extern void tv_add(struct timeval *, struct timeval *, struct timeval *);
-extern void tv_sub(struct timeval *, struct timeval *, struct timeval *);
-extern void tv_mul(struct timeval *, struct timeval *, int);
-extern void tv_div(struct timeval *, struct timeval *, int);
+extern uint64_t monotonic_ns(void);
+extern uint64_t timeval_ns(const struct timeval *);
 
 /* Strace log generation machinery.
  *
@@ -727,6 +846,12 @@ extern void tv_div(struct timeval *, struct timeval *, int);
  * of last line, since in -ff mode just checking printing_tcp for NULL
  * is not enough.
  *
+ * With assemble_lines, which is the default for a shared log written by
+ * several tcbs, tprintf() and tprints() append to tcp->linebuf instead,
+ * and line_ended() writes the whole line out.  Lines of different tcbs
+ * no longer interrupt each other, so "<unfinished ...>" is printed only
+ * when a tcb starts a new line before its current one is finished.
+ *
  * If you change this code, test log generation in both -f and -ff modes
  * using:
  * strace -oLOG -f[f] test/threaded_execve
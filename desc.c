@@ -38,7 +38,7 @@
 # include  <linux/perf_event.h>
 #endif
 
-static const struct xlat fcntlcmds[] = {
+const struct xlat fcntlcmds[] = {
 	XLAT(F_DUPFD),
 	XLAT(F_GETFD),
 	XLAT(F_SETFD),
@@ -530,11 +530,8 @@ decode_select(struct tcb *tcp, long *args, enum bitness_t bitness)
 	if (entering(tcp)) {
 		tprintf("%d", (int) args[0]);
 
-		if (fdsize > 0) {
-			fds = malloc(fdsize);
-			if (!fds)
-				die_out_of_memory();
-		}
+		if (fdsize > 0)
+			fds = arena_alloc(fdsize);
 		for (i = 0; i < 3; i++) {
 			arg = args[i+1];
 			if (arg == 0) {
@@ -560,7 +557,6 @@ decode_select(struct tcb *tcp, long *args, enum bitness_t bitness)
 			}
 			tprints("]");
 		}
-		free(fds);
 		tprints(", ");
 		printtv_bitness(tcp, args[4], bitness, 0);
 	}
@@ -579,9 +575,7 @@ decode_select(struct tcb *tcp, long *args, enum bitness_t bitness)
 			return RVAL_STR;
 		}
 
-		fds = malloc(fdsize);
-		if (!fds)
-			die_out_of_memory();
+		fds = arena_alloc(fdsize);
 
 		outptr = outstr;
 		sep = "";
@@ -616,7 +610,6 @@ decode_select(struct tcb *tcp, long *args, enum bitness_t bitness)
 			if (outptr != outstr)
 				*outptr++ = ']';
 		}
-		free(fds);
 		/* This contains no useful information on SunOS.  */
 		if (args[4]) {
 			if (outptr < end_outstr - (10 + TIMEVAL_TEXT_BUFSIZE)) {
@@ -0,0 +1,590 @@
+/*
+ * Copyright (c) 2014 The strace developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Cache of paths of file descriptors, used by -y and -P.
+ *
+ * Threads of a process share one table of paths, filled lazily by
+ * readlink("/proc/PID/fd/N").  Only successful lookups are cached,
+ * so a descriptor which was not open when it was looked up is looked up
+ * again next time.  Syscalls which may close a descriptor or replace
+ * its file drop the corresponding entries.  Syscalls creating
+ * a descriptor drop it too: it may have been closed by another thread
+ * whose stop after close has not been handled yet.
+ *
+ * The current directory of the process is cached the same way:
+ * it is looked up in /proc/PID/cwd after chdir, and taken from the path
+ * of the descriptor after fchdir.
+ *
+ * The cache is correct only if every process sharing a table
+ * of descriptors (or the current directory) is traced by us.
+ * When this is not known to be the case, caching is disabled for
+ * the process, and every lookup goes to /proc again.
+ */
+
+#include "defs.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/param.h>
+
+#ifndef CLONE_FS
+# define CLONE_FS	0x00000200
+#endif
+#ifndef CLONE_FILES
+# define CLONE_FILES	0x00000400
+#endif
+#ifndef CLONE_THREAD
+# define CLONE_THREAD	0x00010000
+#endif
+#ifndef CLONE_NEWNS
+# define CLONE_NEWNS	0x00020000
+#endif
+#ifndef AT_FDCWD
+# define AT_FDCWD	-100
+#endif
+#if defined S390 || defined S390X || defined CRISV10 || defined CRISV32
+# define ARG_FLAGS	1
+#else
+# define ARG_FLAGS	0
+#endif
+
+/* Descriptors above this are not cached */
+#define FDCACHE_MAX_FD	65536
+
+int fdcache_mode = FDCACHE_ON;
+bool fdcache_enabled = 0;
+
+struct fdcache {
+	struct fdcache *next;
+	int tgid;
+	unsigned int refcnt;	/* number of tcbs using this cache */
+	bool disabled;
+	unsigned int size;	/* number of elements in path[] */
+	char **path;		/* NULL if not known */
+	bool cwd_disabled;
+	char *cwd;		/* NULL if not known */
+};
+
+static struct fdcache *fdcache_list;
+static unsigned long fdcache_hits, fdcache_misses, fdcache_mismatches;
+
+/* What a syscall does to the descriptor table on exit */
+enum {
+	FDC_NONE,
+	FDC_RVAL,	/* returns a new descriptor */
+	FDC_ARG0,	/* closes arg0 */
+	FDC_ARG1,	/* replaces arg1 */
+	FDC_FCNTL,	/* returns a new descriptor for F_DUPFD* */
+	FDC_PAIR0,	/* stores two new descriptors at arg0 */
+	FDC_PAIR3,	/* stores two new descriptors at arg3 */
+	FDC_EXEC,	/* closes O_CLOEXEC descriptors */
+	FDC_CLONE,	/* may share the table with a new process */
+	FDC_UNSHARE,	/* may unshare the table or the directory */
+	FDC_CHDIR,	/* changes the directory */
+	FDC_FCHDIR,	/* changes the directory to arg0 */
+	FDC_RECV,	/* may receive descriptors with SCM_RIGHTS */
+	FDC_RENAME	/* may change paths of files open anywhere,
+			   and of current directories */
+};
+
+static const struct {
+	const char *name;
+	unsigned char action;
+} fdcache_syscalls[] = {
+	{ "open",		FDC_RVAL	},
+	{ "openat",		FDC_RVAL	},
+	{ "creat",		FDC_RVAL	},
+	{ "open_by_handle_at",	FDC_RVAL	},
+	{ "dup",		FDC_RVAL	},
+	{ "socket",		FDC_RVAL	},
+	{ "accept",		FDC_RVAL	},
+	{ "accept4",		FDC_RVAL	},
+	{ "epoll_create",	FDC_RVAL	},
+	{ "epoll_create1",	FDC_RVAL	},
+	{ "eventfd",		FDC_RVAL	},
+	{ "eventfd2",		FDC_RVAL	},
+	{ "signalfd",		FDC_RVAL	},
+	{ "signalfd4",		FDC_RVAL	},
+	{ "timerfd_create",	FDC_RVAL	},
+	{ "inotify_init",	FDC_RVAL	},
+	{ "inotify_init1",	FDC_RVAL	},
+	{ "fanotify_init",	FDC_RVAL	},
+	{ "perf_event_open",	FDC_RVAL	},
+	{ "close",		FDC_ARG0	},
+	{ "dup2",		FDC_ARG1	},
+	{ "dup3",		FDC_ARG1	},
+	{ "fcntl",		FDC_FCNTL	},
+	{ "fcntl64",		FDC_FCNTL	},
+	{ "pipe",		FDC_PAIR0	},
+	{ "pipe2",		FDC_PAIR0	},
+	{ "socketpair",		FDC_PAIR3	},
+	{ "recvmsg",		FDC_RECV	},
+	{ "recvmmsg",		FDC_RECV	},
+	{ "execve",		FDC_EXEC	},
+	{ "clone",		FDC_CLONE	},
+	{ "clone2",		FDC_CLONE	},
+	{ "unshare",		FDC_UNSHARE	},
+	{ "chdir",		FDC_CHDIR	},
+	{ "chroot",		FDC_CHDIR	},
+	{ "fchdir",		FDC_FCHDIR	},
+	{ "rename",		FDC_RENAME	},
+	{ "renameat",		FDC_RENAME	},
+	{ "unlink",		FDC_RENAME	},
+	{ "unlinkat",		FDC_RENAME	},
+	{ "rmdir",		FDC_RENAME	},
+	{ "mount",		FDC_RENAME	},
+	{ "umount",		FDC_RENAME	},
+	{ "umount2",		FDC_RENAME	},
+	{ "oldumount",		FDC_RENAME	},
+	{ "pivot_root",		FDC_RENAME	}
+};
+
+/* Per personality, action of each syscall */
+static unsigned char *fdcache_actions[SUPPORTED_PERSONALITIES];
+
+static unsigned int
+fdcache_action(unsigned long scno)
+{
+	unsigned char *actions = fdcache_actions[current_personality];
+
+	if (!actions) {
+		unsigned int i, j;
+
+		actions = calloc(nsyscalls, 1);
+		if (!actions)
+			die_out_of_memory();
+		for (i = 0; i < nsyscalls; ++i) {
+			if (!sysent[i].sys_name)
+				continue;
+			for (j = 0; j < ARRAY_SIZE(fdcache_syscalls); ++j) {
+				if (strcmp(sysent[i].sys_name,
+					   fdcache_syscalls[j].name) == 0) {
+					actions[i] = fdcache_syscalls[j].action;
+					break;
+				}
+			}
+		}
+		fdcache_actions[current_personality] = actions;
+	}
+	return scno < nsyscalls ? actions[scno] : FDC_NONE;
+}
+
+/*
+ * Return true if syscall scno has to stop the tracee
+ * for the cache to stay correct.
+ */
+bool
+fdcache_needs_scno(unsigned int scno)
+{
+	return fdcache_action(scno) != FDC_NONE;
+}
+
+/*
+ * Read thread group id and number of threads from /proc/PID/status.
+ */
+int
+read_tgid(int pid, int *nthreads)
+{
+	char path[sizeof("/proc/%u/status") + sizeof(int)*3];
+	char buf[2048];
+	const char *p;
+	int fd, tgid = -1;
+	ssize_t n;
+
+	*nthreads = 0;
+	sprintf(path, "/proc/%u/status", pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+	p = strstr(buf, "\nTgid:");
+	if (p)
+		tgid = atoi(p + sizeof("\nTgid:") - 1);
+	p = strstr(buf, "\nThreads:");
+	if (p)
+		*nthreads = atoi(p + sizeof("\nThreads:") - 1);
+	return tgid > 0 ? tgid : -1;
+}
+
+static struct fdcache *
+find_fdcache(int tgid)
+{
+	struct fdcache *c;
+
+	for (c = fdcache_list; c; c = c->next)
+		if (c->tgid == tgid)
+			return c;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		die_out_of_memory();
+	c->tgid = tgid;
+	c->next = fdcache_list;
+	fdcache_list = c;
+	return c;
+}
+
+static void
+flush_fdcache(struct fdcache *c)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->size; ++i) {
+		free(c->path[i]);
+		c->path[i] = NULL;
+	}
+}
+
+static void
+disable_fdcache(struct fdcache *c)
+{
+	if (debug_flag && !c->disabled)
+		fprintf(stderr, "fd cache disabled for pid %d\n", c->tgid);
+	flush_fdcache(c);
+	free(c->path);
+	c->path = NULL;
+	c->size = 0;
+	c->disabled = 1;
+}
+
+static void
+disable_cwd(struct fdcache *c)
+{
+	free(c->cwd);
+	c->cwd = NULL;
+	c->cwd_disabled = 1;
+}
+
+static void
+drop_fd(struct fdcache *c, long fd)
+{
+	if (fd >= 0 && (unsigned long) fd < c->size) {
+		free(c->path[fd]);
+		c->path[fd] = NULL;
+	}
+}
+
+/*
+ * Return the cache of tcp's process, creating it if needed.
+ */
+static struct fdcache *
+attach_fdcache(struct tcb *tcp)
+{
+	if (!tcp->fdcache) {
+		int nthreads;
+		int tgid = read_tgid(tcp->pid, &nthreads);
+
+		if (tgid < 0) {
+			/* A private disabled cache */
+			tcp->fdcache = find_fdcache(-tcp->pid);
+			disable_fdcache(tcp->fdcache);
+			disable_cwd(tcp->fdcache);
+		} else {
+			tcp->fdcache = find_fdcache(tgid);
+			/* Without -f, other threads are not traced */
+			if (!followfork && nthreads > 1) {
+				disable_fdcache(tcp->fdcache);
+				disable_cwd(tcp->fdcache);
+			}
+		}
+		tcp->fdcache->refcnt++;
+	}
+	return tcp->fdcache;
+}
+
+void
+fdcache_release(struct tcb *tcp)
+{
+	struct fdcache *c = tcp->fdcache, **pc;
+
+	if (!c)
+		return;
+	tcp->fdcache = NULL;
+	if (--c->refcnt)
+		return;
+	for (pc = &fdcache_list; *pc != c; pc = &(*pc)->next)
+		;
+	*pc = c->next;
+	flush_fdcache(c);
+	free(c->path);
+	free(c->cwd);
+	free(c);
+}
+
+/*
+ * Return the slot of fd in the cache, or NULL if fd is not cached.
+ */
+static char **
+fd_slot(struct fdcache *c, int fd)
+{
+	if (c->disabled || fd < 0 || fd >= FDCACHE_MAX_FD)
+		return NULL;
+	if ((unsigned int) fd >= c->size) {
+		unsigned int size = c->size ? c->size : 64;
+
+		while (size <= (unsigned int) fd)
+			size *= 2;
+		c->path = realloc(c->path, size * sizeof(c->path[0]));
+		if (!c->path)
+			die_out_of_memory();
+		memset(c->path + c->size, 0,
+		       (size - c->size) * sizeof(c->path[0]));
+		c->size = size;
+	}
+	return &c->path[fd];
+}
+
+/*
+ * Return the path in *slot, or read it with readfdpath and store
+ * it there.  slot is NULL if the path is not cached.
+ */
+static int
+cached_path(struct tcb *tcp, int fd, char **slot, char *buf, unsigned bufsize)
+{
+	const char *cached = slot ? *slot : NULL;
+	int n;
+
+	if (cached && fdcache_mode != FDCACHE_CHECK) {
+		++fdcache_hits;
+		n = strlen(cached);
+		if ((unsigned int) n >= bufsize)
+			n = bufsize - 1;
+		memcpy(buf, cached, n);
+		buf[n] = '\0';
+		return n;
+	}
+
+	n = readfdpath(tcp->pid, fd, buf, bufsize);
+	if (!slot)
+		return n;
+	if (cached) {
+		++fdcache_hits;
+		if (n < 0 || strcmp(cached, buf) != 0) {
+			char what[sizeof("fd %d") + sizeof(int)*3];
+
+			if (fd == AT_FDCWD)
+				strcpy(what, "cwd");
+			else
+				sprintf(what, "fd %d", fd);
+			++fdcache_mismatches;
+			error_msg("fd cache mismatch: pid %d %s: "
+				  "cached \"%s\", actual \"%s\"",
+				  tcp->pid, what, cached, n < 0 ? "" : buf);
+		}
+	} else
+		++fdcache_misses;
+	free(*slot);
+	*slot = NULL;
+	if (n >= 0) {
+		*slot = strdup(buf);
+		if (!*slot)
+			die_out_of_memory();
+	}
+	return n;
+}
+
+/*
+ * Like readfdpath, but look in the cache first.
+ */
+int
+fdcache_getpath(struct tcb *tcp, int fd, char *buf, unsigned bufsize)
+{
+	return cached_path(tcp, fd, fd_slot(attach_fdcache(tcp), fd),
+			   buf, bufsize);
+}
+
+/*
+ * Get the current directory of tcp, look in the cache first.
+ */
+int
+fdcache_getcwd(struct tcb *tcp, char *buf, unsigned bufsize)
+{
+	struct fdcache *c = attach_fdcache(tcp);
+
+	return cached_path(tcp, AT_FDCWD, c->cwd_disabled ? NULL : &c->cwd,
+			   buf, bufsize);
+}
+
+/*
+ * Update the cache of tcp's process after a syscall.
+ */
+void
+fdcache_syscall_exit(struct tcb *tcp)
+{
+	struct fdcache *c;
+	unsigned int action;
+	unsigned long flags;
+	char path[PATH_MAX + 1];
+	int fds[2];
+
+	if (tcp->qual_flg & UNDEFINED_SCNO) {
+		/* Could close anything */
+		if (tcp->fdcache)
+			flush_fdcache(tcp->fdcache);
+		return;
+	}
+	action = fdcache_action(tcp->scno);
+	if (action == FDC_NONE)
+		return;
+	/*
+	 * Other threads may have cached something
+	 * even if this one has not looked anything up yet.
+	 */
+	c = attach_fdcache(tcp);
+
+	switch (action) {
+	case FDC_RVAL:
+		if (!syserror(tcp))
+			drop_fd(c, tcp->u_rval);
+		break;
+	case FDC_ARG0:
+		/* The descriptor is closed even if close fails */
+		drop_fd(c, (int) tcp->u_arg[0]);
+		break;
+	case FDC_ARG1:
+		if (!syserror(tcp))
+			drop_fd(c, (int) tcp->u_arg[1]);
+		break;
+	case FDC_FCNTL:
+		if (syserror(tcp))
+			break;
+		switch (tcp->u_arg[1]) {
+		case F_DUPFD:
+#ifdef F_DUPFD_CLOEXEC
+		case F_DUPFD_CLOEXEC:
+#endif
+			drop_fd(c, tcp->u_rval);
+		}
+		break;
+	case FDC_PAIR0:
+	case FDC_PAIR3:
+		if (syserror(tcp) || c->disabled)
+			break;
+		if (umove(tcp, tcp->u_arg[action == FDC_PAIR0 ? 0 : 3], &fds) < 0) {
+			flush_fdcache(c);
+			break;
+		}
+		drop_fd(c, fds[0]);
+		drop_fd(c, fds[1]);
+		break;
+	case FDC_RECV:
+		/*
+		 * Received descriptors are not known, and one of them
+		 * may reuse a descriptor just closed by another thread.
+		 */
+		if (!syserror(tcp) && c->refcnt > 1)
+			flush_fdcache(c);
+		break;
+	case FDC_EXEC:
+		if (!syserror(tcp))
+			flush_fdcache(c);
+		break;
+	case FDC_RENAME:
+		if (syserror(tcp))
+			break;
+		/* Current directories may have been moved as well */
+		for (c = fdcache_list; c; c = c->next) {
+			flush_fdcache(c);
+			free(c->cwd);
+			c->cwd = NULL;
+		}
+		break;
+	case FDC_CHDIR:
+		if (!syserror(tcp)) {
+			free(c->cwd);
+			c->cwd = NULL;
+		}
+		break;
+	case FDC_FCHDIR:
+		if (syserror(tcp) || c->cwd_disabled)
+			break;
+		free(c->cwd);
+		c->cwd = NULL;
+		if (fdcache_getpath(tcp, (int) tcp->u_arg[0], path, sizeof(path)) > 0
+		    && path[0] == '/') {
+			c->cwd = strdup(path);
+			if (!c->cwd)
+				die_out_of_memory();
+		}
+		break;
+	case FDC_CLONE:
+		if (syserror(tcp) || tcp->u_rval <= 0)
+			break;
+		flags = tcp->u_arg[ARG_FLAGS];
+		if (flags & CLONE_FILES) {
+			/* Without -f, the new process is not traced */
+			if (!followfork)
+				disable_fdcache(c);
+			/* A new process sharing our table */
+			else if (!(flags & CLONE_THREAD)) {
+				disable_fdcache(c);
+				disable_fdcache(find_fdcache(tcp->u_rval));
+			}
+		} else if (flags & CLONE_THREAD) {
+			/* A thread with its own table */
+			disable_fdcache(c);
+		}
+		/* The same for the current directory */
+		if (flags & CLONE_FS) {
+			if (!followfork)
+				disable_cwd(c);
+			else if (!(flags & CLONE_THREAD)) {
+				disable_cwd(c);
+				disable_cwd(find_fdcache(tcp->u_rval));
+			}
+		} else if (flags & CLONE_THREAD)
+			disable_cwd(c);
+		break;
+	case FDC_UNSHARE:
+		if (syserror(tcp))
+			break;
+		if (tcp->u_arg[0] & CLONE_FILES)
+			disable_fdcache(c);
+		if (tcp->u_arg[0] & (CLONE_FS | CLONE_NEWNS))
+			disable_cwd(c);
+		break;
+	}
+}
+
+void
+fdcache_stats(void)
+{
+	unsigned long total = fdcache_hits + fdcache_misses;
+
+	if (!fdcache_enabled)
+		return;
+	fprintf(stderr, "fd cache: %lu hits, %lu misses, %lu%% hit rate\n",
+		fdcache_hits, fdcache_misses,
+		total ? fdcache_hits * 100 / total : 0);
+	if (fdcache_mode == FDCACHE_CHECK)
+		fprintf(stderr, "fd cache: %lu mismatches\n",
+			fdcache_mismatches);
+}
@@ -2273,12 +2273,9 @@ sys_getdents(struct tcb *tcp)
 		len = 1024*1024;
 	if (tcp->u_rval < 0)
 		len = 0;
-	buf = len ? malloc(len) : NULL;
-	if (len && !buf)
-		die_out_of_memory();
+	buf = len ? arena_alloc(len) : NULL;
 	if (umoven(tcp, tcp->u_arg[1], len, buf) < 0) {
 		tprintf("%#lx, %lu", tcp->u_arg[1], tcp->u_arg[2]);
-		free(buf);
 		return 0;
 	}
 	if (!abbrev(tcp))
@@ -2305,7 +2302,6 @@ sys_getdents(struct tcb *tcp)
 	else
 		tprintf("/* %u entries */", dents);
 	tprintf(", %lu", tcp->u_arg[2]);
-	free(buf);
 	return 0;
 }
 
@@ -2331,13 +2327,10 @@ sys_getdents64(struct tcb *tcp)
 		len = 1024*1024;
 	if (tcp->u_rval < 0)
 		len = 0;
-	buf = len ? malloc(len) : NULL;
-	if (len && !buf)
-		die_out_of_memory();
+	buf = len ? arena_alloc(len) : NULL;
 
 	if (umoven(tcp, tcp->u_arg[1], len, buf) < 0) {
 		tprintf("%#lx, %lu", tcp->u_arg[1], tcp->u_arg[2]);
-		free(buf);
 		return 0;
 	}
 	if (!abbrev(tcp))
@@ -2367,7 +2360,6 @@ sys_getdents64(struct tcb *tcp)
 	else
 		tprintf("/* %u entries */", dents);
 	tprintf(", %lu", tcp->u_arg[2]);
-	free(buf);
 	return 0;
 }
 
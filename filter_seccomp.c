@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2014 The strace developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * --seccomp-bpf support.
+ *
+ * The set of syscalls selected by -e trace=... is compiled into
+ * a classic BPF program which is installed into the tracee right before
+ * the first execve.  The program returns SECCOMP_RET_TRACE for the syscalls
+ * we are interested in and SECCOMP_RET_ALLOW for everything else,
+ * so the tracee can be resumed with PTRACE_CONT instead of PTRACE_SYSCALL
+ * and uninteresting syscalls do not cause any ptrace stops at all.
+ */
+
+#include "defs.h"
+#include "syscall.h"
+#ifdef HAVE_PRCTL
+# include <sys/prctl.h>
+#endif
+#ifdef HAVE_LINUX_FILTER_H
+# include <linux/filter.h>
+#endif
+#ifdef HAVE_LINUX_SECCOMP_H
+# include <linux/seccomp.h>
+#endif
+#ifdef HAVE_LINUX_AUDIT_H
+# include <linux/audit.h>
+#endif
+
+#ifndef PR_SET_SECCOMP
+# define PR_SET_SECCOMP 22
+#endif
+#ifndef PR_SET_NO_NEW_PRIVS
+# define PR_SET_NO_NEW_PRIVS 38
+#endif
+#ifndef SECCOMP_MODE_FILTER
+# define SECCOMP_MODE_FILTER 2
+#endif
+#ifndef SECCOMP_RET_TRACE
+# define SECCOMP_RET_TRACE 0x7ff00000U
+#endif
+#ifndef SECCOMP_RET_ALLOW
+# define SECCOMP_RET_ALLOW 0x7fff0000U
+#endif
+#ifndef BPF_MAXINSNS
+# define BPF_MAXINSNS 4096
+#endif
+
+/* Offsets of nr and arch fields in struct seccomp_data */
+#define SECCOMP_DATA_NR		0
+#define SECCOMP_DATA_ARCH	4
+
+bool seccomp_filtering = 0;
+
+#if defined(HAVE_PRCTL) && defined(HAVE_LINUX_FILTER_H) && defined(HAVE_LINUX_AUDIT_H)
+
+/*
+ * How syscall numbers of the personality are distinguished
+ * from those of another personality sharing the same audit arch.
+ */
+enum {
+	NR_PLAIN,	/* no other personality with this audit arch */
+	NR_NO_X32,	/* syscall number must not have __X32_SYSCALL_BIT */
+	NR_X32		/* syscall number must have __X32_SYSCALL_BIT */
+};
+
+struct audit_arch_t {
+	unsigned int arch;
+	unsigned int flag;
+};
+
+# ifndef __X32_SYSCALL_BIT
+#  define __X32_SYSCALL_BIT	0x40000000
+# endif
+
+static const struct audit_arch_t audit_arch_vec[SUPPORTED_PERSONALITIES] = {
+# if defined X86_64
+	{ AUDIT_ARCH_X86_64, NR_NO_X32 },
+	{ AUDIT_ARCH_I386, NR_PLAIN },
+	{ AUDIT_ARCH_X86_64, NR_X32 },
+# elif defined X32
+	{ AUDIT_ARCH_X86_64, NR_X32 },
+	{ AUDIT_ARCH_I386, NR_PLAIN },
+# elif defined I386
+	{ AUDIT_ARCH_I386, NR_PLAIN },
+# elif defined AARCH64
+	{ AUDIT_ARCH_ARM, NR_PLAIN },
+	{ AUDIT_ARCH_AARCH64, NR_PLAIN },
+# elif defined ARM
+	{ AUDIT_ARCH_ARM, NR_PLAIN },
+# elif defined POWERPC64
+#  if defined(__LITTLE_ENDIAN__) && defined(AUDIT_ARCH_PPC64LE)
+	{ AUDIT_ARCH_PPC64LE, NR_PLAIN },
+#  else
+	{ AUDIT_ARCH_PPC64, NR_PLAIN },
+#  endif
+	{ AUDIT_ARCH_PPC, NR_PLAIN },
+# elif defined POWERPC
+	{ AUDIT_ARCH_PPC, NR_PLAIN },
+# elif defined S390X
+	{ AUDIT_ARCH_S390X, NR_PLAIN },
+# elif defined S390
+	{ AUDIT_ARCH_S390, NR_PLAIN },
+# else
+#  define SECCOMP_FILTER_UNSUPPORTED_ARCH
+	{ 0, NR_PLAIN },
+# endif
+};
+
+static struct sock_filter *filter;
+static unsigned int filter_len;
+static unsigned int filter_size;
+
+static unsigned int
+emit(unsigned short code, unsigned int k, unsigned char jt, unsigned char jf)
+{
+	if (filter_len >= filter_size) {
+		filter_size = filter_size ? filter_size * 2 : 256;
+		filter = realloc(filter, filter_size * sizeof(*filter));
+		if (!filter)
+			die_out_of_memory();
+	}
+	filter[filter_len].code = code;
+	filter[filter_len].jt = jt;
+	filter[filter_len].jf = jf;
+	filter[filter_len].k = k;
+	return filter_len++;
+}
+
+/*
+ * Does syscall scno of the current personality have to stop the tracee?
+ * Unknown syscalls are always shown, execve is needed for -b execve
+ * and for hiding the log until the tracee is started, syscalls changing
+ * the descriptor table are needed by --fd-cache, and socketcall/ipc
+ * have to stop if any of their subcalls is of interest.
+ */
+static bool
+traced_scno(unsigned int scno)
+{
+	const struct_sysent *s = &sysent[scno];
+
+	if (!s->sys_func || (qual_flags[scno] & QUAL_TRACE))
+		return 1;
+	if (s->sys_func == sys_execve)
+		return 1;
+	if (fdcache_enabled && fdcache_needs_scno(scno))
+		return 1;
+# ifdef SYS_socket_subcall
+	if (s->sys_func == sys_socketcall) {
+		unsigned int i;
+
+		for (i = SYS_socket_subcall;
+		     i < SYS_socket_subcall + SYS_socket_nsubcalls && i < nsyscalls;
+		     ++i)
+			if (qual_flags[i] & QUAL_TRACE)
+				return 1;
+	}
+# endif
+# ifdef SYS_ipc_subcall
+	if (s->sys_func == sys_ipc) {
+		unsigned int i;
+
+		for (i = SYS_ipc_subcall;
+		     i < SYS_ipc_subcall + SYS_ipc_nsubcalls && i < nsyscalls;
+		     ++i)
+			if (qual_flags[i] & QUAL_TRACE)
+				return 1;
+	}
+# endif
+	return 0;
+}
+
+static void
+emit_personality(const struct audit_arch_t *a)
+{
+	unsigned int skip_arch, skip_x32 = 0;
+	unsigned int lo, hi;
+
+	emit(BPF_LD | BPF_W | BPF_ABS, SECCOMP_DATA_ARCH, 0, 0);
+	emit(BPF_JMP | BPF_JEQ | BPF_K, a->arch, 1, 0);
+	skip_arch = emit(BPF_JMP | BPF_JA, 0, 0, 0);
+	emit(BPF_LD | BPF_W | BPF_ABS, SECCOMP_DATA_NR, 0, 0);
+	switch (a->flag) {
+	case NR_NO_X32:
+		emit(BPF_JMP | BPF_JGE | BPF_K, __X32_SYSCALL_BIT, 0, 1);
+		skip_x32 = emit(BPF_JMP | BPF_JA, 0, 0, 0);
+		break;
+	case NR_X32:
+		emit(BPF_JMP | BPF_JGE | BPF_K, __X32_SYSCALL_BIT, 1, 0);
+		skip_x32 = emit(BPF_JMP | BPF_JA, 0, 0, 0);
+		emit(BPF_ALU | BPF_SUB | BPF_K, __X32_SYSCALL_BIT, 0, 0);
+		break;
+	}
+
+	/* Every syscall number beyond the table is traced */
+	for (lo = 0; lo < nsyscalls; lo = hi) {
+		if (!traced_scno(lo)) {
+			hi = lo + 1;
+			continue;
+		}
+		for (hi = lo + 1; hi < nsyscalls && traced_scno(hi); ++hi)
+			;
+		if (hi >= nsyscalls)
+			break;
+		if (hi == lo + 1) {
+			emit(BPF_JMP | BPF_JEQ | BPF_K, lo, 0, 1);
+		} else {
+			if (lo)
+				emit(BPF_JMP | BPF_JGE | BPF_K, lo, 0, 2);
+			emit(BPF_JMP | BPF_JGE | BPF_K, hi, 1, 0);
+		}
+		emit(BPF_RET | BPF_K, SECCOMP_RET_TRACE, 0, 0);
+	}
+	emit(BPF_JMP | BPF_JGE | BPF_K, lo, 0, 1);
+	emit(BPF_RET | BPF_K, SECCOMP_RET_TRACE, 0, 0);
+	emit(BPF_RET | BPF_K, SECCOMP_RET_ALLOW, 0, 0);
+
+	filter[skip_arch].k = filter_len - skip_arch - 1;
+	if (skip_x32)
+		filter[skip_x32].k = filter_len - skip_x32 - 1;
+}
+
+/*
+ * Called by the tracer after option parsing.
+ * Builds the filter, or disables --seccomp-bpf if it cannot be used.
+ */
+void
+init_seccomp_filter(void)
+{
+	int pers, old_pers = current_personality;
+
+# ifdef SECCOMP_FILTER_UNSUPPORTED_ARCH
+	error_msg("--seccomp-bpf is not supported on this architecture");
+	seccomp_filtering = 0;
+	return;
+# endif
+	if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, NULL) == 0
+	    || (errno != EFAULT && errno != EACCES)) {
+		error_msg("--seccomp-bpf is not supported by the kernel");
+		seccomp_filtering = 0;
+		return;
+	}
+
+	for (pers = 0; pers < SUPPORTED_PERSONALITIES; ++pers) {
+		if (current_personality != pers)
+			set_personality(pers);
+		emit_personality(&audit_arch_vec[pers]);
+	}
+	if (old_pers != current_personality)
+		set_personality(old_pers);
+	emit(BPF_RET | BPF_K, SECCOMP_RET_TRACE, 0, 0);
+
+	if (filter_len > BPF_MAXINSNS) {
+		error_msg("--seccomp-bpf filter is too big (%u instructions), "
+			  "disabled", filter_len);
+		seccomp_filtering = 0;
+		return;
+	}
+	if (debug_flag)
+		fprintf(stderr, "seccomp filter: %u instructions\n", filter_len);
+}
+
+/* Called by the tracee right before execve */
+void
+apply_seccomp_filter(void)
+{
+	struct sock_fprog prog = {
+		.len = filter_len,
+		.filter = filter
+	};
+
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0)
+		perror_msg_and_die("prctl(PR_SET_NO_NEW_PRIVS)");
+	if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) < 0)
+		perror_msg_and_die("prctl(PR_SET_SECCOMP)");
+}
+
+#else /* !(HAVE_PRCTL && HAVE_LINUX_FILTER_H && HAVE_LINUX_AUDIT_H) */
+
+void
+init_seccomp_filter(void)
+{
+	error_msg("--seccomp-bpf is not supported by this build of strace");
+	seccomp_filtering = 0;
+}
+
+void
+apply_seccomp_filter(void)
+{
+}
+
+#endif
@@ -31,30 +31,68 @@
 #include "defs.h"
 #include <asm/ioctl.h>
 
-static int
-compare(const void *a, const void *b)
+/*
+ * ioctlent is sorted by code, so the entries of each _IOC_TYPE form
+ * a contiguous range, sorted by _IOC_NR.  For each personality,
+ * the ranges of all types are found on the first lookup, and for each
+ * type, the first entry of every _IOC_NR is found on the first lookup
+ * of that type, so a lookup costs two array accesses instead of
+ * a bsearch() over the whole table.
+ */
+struct ioctl_index {
+	bool built;
+	/* Entries of type T are ioctlent[start[T]] .. ioctlent[start[T+1]-1] */
+	unsigned int start[_IOC_TYPEMASK + 2];
+	/* by_nr[T][N]: offset of the first entry for N from start[T] + 1 */
+	unsigned short *by_nr[_IOC_TYPEMASK + 1];
+};
+
+static struct ioctl_index ioctl_indexes[SUPPORTED_PERSONALITIES];
+
+static void
+build_ioctl_index(struct ioctl_index *idx)
 {
-	unsigned long code1 = (long) a;
-	unsigned long code2 = ((struct_ioctlent *) b)->code;
-	return (code1 > code2) ? 1 : (code1 < code2) ? -1 : 0;
+	unsigned int i, type = 0;
+
+	for (i = 0; i < nioctlents; i++)
+		while (type <= _IOC_TYPE(ioctlent[i].code))
+			idx->start[type++] = i;
+	while (type <= _IOC_TYPEMASK + 1)
+		idx->start[type++] = nioctlents;
+	idx->built = true;
+}
+
+static const unsigned short *
+ioctl_type_index(struct ioctl_index *idx, unsigned int type)
+{
+	unsigned int i;
+	unsigned short *by_nr;
+
+	if (idx->by_nr[type])
+		return idx->by_nr[type];
+
+	by_nr = calloc(_IOC_NRMASK + 1, sizeof(*by_nr));
+	if (!by_nr)
+		die_out_of_memory();
+	for (i = idx->start[type + 1]; i-- > idx->start[type]; )
+		by_nr[_IOC_NR(ioctlent[i].code)] = i - idx->start[type] + 1;
+	idx->by_nr[type] = by_nr;
+	return by_nr;
 }
 
 const struct_ioctlent *
 ioctl_lookup(long code)
 {
-	struct_ioctlent *iop;
+	struct ioctl_index *idx = &ioctl_indexes[current_personality];
+	unsigned int type = _IOC_TYPE(code);
+	unsigned int n;
 
-	code &= (_IOC_NRMASK<<_IOC_NRSHIFT) | (_IOC_TYPEMASK<<_IOC_TYPESHIFT);
-	iop = bsearch((void*)code, ioctlent,
-			nioctlents, sizeof(ioctlent[0]), compare);
-	while (iop > ioctlent) {
-		iop--;
-		if (iop->code != code) {
-			iop++;
-			break;
-		}
-	}
-	return iop;
+	if (!idx->built)
+		build_ioctl_index(idx);
+	if (idx->start[type] == idx->start[type + 1])
+		return NULL;
+	n = ioctl_type_index(idx, type)[_IOC_NR(code)];
+	return n ? &ioctlent[idx->start[type] + n - 1] : NULL;
 }
 
 const struct_ioctlent *
@@ -342,7 +342,7 @@ keyctl_set_reqkey_keyring(struct tcb *tcp, int reqkey)
 	return 0;
 }
 
-static const struct xlat keyctl_commands[] = {
+const struct xlat keyctl_commands[] = {
 	XLAT(KEYCTL_GET_KEYRING_ID),
 	XLAT(KEYCTL_JOIN_SESSION_KEYRING),
 	XLAT(KEYCTL_UPDATE),
@@ -1592,40 +1592,36 @@ printmsghdr(struct tcb *tcp, long addr, unsigned long data_size)
 	do_msghdr(tcp, &msg, data_size);
 }
 
+/* Not every libc has struct mmsghdr */
+struct strace_mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned msg_len;
+};
+
+/*
+ * Print an element of the mmsghdr array fetched by decode_mmsg,
+ * which is in 32-bit layout if the tracee is 32-bit.
+ */
 static void
-printmmsghdr(struct tcb *tcp, long addr, unsigned int idx, unsigned long msg_len)
+printmmsghdr(struct tcb *tcp, const void *data, unsigned long msg_len)
 {
-	struct mmsghdr {
-		struct msghdr msg_hdr;
-		unsigned msg_len;
-	} mmsg;
+	struct strace_mmsghdr mmsg;
 
 #if SUPPORTED_PERSONALITIES > 1 && SIZEOF_LONG > 4
 	if (current_wordsize == 4) {
-		struct mmsghdr32 mmsg32;
-
-		addr += sizeof(mmsg32) * idx;
-		if (umove(tcp, addr, &mmsg32) < 0) {
-			tprintf("%#lx", addr);
-			return;
-		}
-		mmsg.msg_hdr.msg_name       = (void*)(long)mmsg32.msg_hdr.msg_name;
-		mmsg.msg_hdr.msg_namelen    =              mmsg32.msg_hdr.msg_namelen;
-		mmsg.msg_hdr.msg_iov        = (void*)(long)mmsg32.msg_hdr.msg_iov;
-		mmsg.msg_hdr.msg_iovlen     =              mmsg32.msg_hdr.msg_iovlen;
-		mmsg.msg_hdr.msg_control    = (void*)(long)mmsg32.msg_hdr.msg_control;
-		mmsg.msg_hdr.msg_controllen =              mmsg32.msg_hdr.msg_controllen;
-		mmsg.msg_hdr.msg_flags      =              mmsg32.msg_hdr.msg_flags;
-		mmsg.msg_len                =              mmsg32.msg_len;
+		const struct mmsghdr32 *mmsg32 = data;
+
+		mmsg.msg_hdr.msg_name       = (void*)(long)mmsg32->msg_hdr.msg_name;
+		mmsg.msg_hdr.msg_namelen    =              mmsg32->msg_hdr.msg_namelen;
+		mmsg.msg_hdr.msg_iov        = (void*)(long)mmsg32->msg_hdr.msg_iov;
+		mmsg.msg_hdr.msg_iovlen     =              mmsg32->msg_hdr.msg_iovlen;
+		mmsg.msg_hdr.msg_control    = (void*)(long)mmsg32->msg_hdr.msg_control;
+		mmsg.msg_hdr.msg_controllen =              mmsg32->msg_hdr.msg_controllen;
+		mmsg.msg_hdr.msg_flags      =              mmsg32->msg_hdr.msg_flags;
+		mmsg.msg_len                =              mmsg32->msg_len;
 	} else
 #endif
-	{
-		addr += sizeof(mmsg) * idx;
-		if (umove(tcp, addr, &mmsg) < 0) {
-			tprintf("%#lx", addr);
-			return;
-		}
-	}
+		memcpy(&mmsg, data, sizeof(mmsg));
 	tprints("{");
 	do_msghdr(tcp, &mmsg.msg_hdr, msg_len ? msg_len : mmsg.msg_len);
 	tprintf(", %u}", mmsg.msg_len);
@@ -1640,12 +1636,36 @@ decode_mmsg(struct tcb *tcp, unsigned long msg_len)
 	} else {
 		unsigned int len = tcp->u_rval;
 		unsigned int i;
+		long addr = tcp->u_arg[1];
+		unsigned int elsize = sizeof(struct strace_mmsghdr);
+		/* mmsghdrs are fetched in batches */
+		union {
+			struct strace_mmsghdr mmsg[16];
+#if SUPPORTED_PERSONALITIES > 1 && SIZEOF_LONG > 4
+			struct mmsghdr32 mmsg32[16];
+#endif
+		} buf;
+		unsigned int nbuf = 0, ibuf = 0;
 
+#if SUPPORTED_PERSONALITIES > 1 && SIZEOF_LONG > 4
+		if (current_wordsize == 4)
+			elsize = sizeof(struct mmsghdr32);
+#endif
 		tprints("{");
-		for (i = 0; i < len; ++i) {
+		for (i = 0; i < len; ++i, addr += elsize) {
 			if (i)
 				tprints(", ");
-			printmmsghdr(tcp, tcp->u_arg[1], i, msg_len);
+			if (ibuf == nbuf) {
+				ibuf = 0;
+				nbuf = umove_array(tcp, addr, elsize,
+						   MIN(len - i, ARRAY_SIZE(buf.mmsg)),
+						   &buf);
+			}
+			if (ibuf == nbuf) {
+				tprintf("%#lx", addr);
+				continue;
+			}
+			printmmsghdr(tcp, (char *) &buf + elsize * ibuf++, msg_len);
 		}
 		tprints("}");
 	}
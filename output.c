@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2014 The strace developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous output (--output-buffer).
+ *
+ * Log files opened for -o are replaced with fopencookie() streams.
+ * Whatever stdio flushes into them is appended to a preallocated ring
+ * buffer, and a writer thread drains the ring with writev().  Thus a slow
+ * disk or a slow "-o |command" pipe does not stop the tracer (and tracees)
+ * unless the ring gets full.
+ *
+ * The ring has a single producer (the tracer) and a single consumer
+ * (the writer thread); head and tail are only advanced by their owners,
+ * the mutex is used only to sleep when there is nothing to do.
+ */
+
+#include "defs.h"
+
+#if defined(HAVE_FOPENCOOKIE) && defined(HAVE_PTHREAD_H)
+
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+# define IOV_MAX 1024
+#endif
+
+enum {
+	REC_DATA,	/* data to be written */
+	REC_PAD,	/* unused space up to the end of the ring */
+	REC_CLOSE	/* close the file */
+};
+
+struct rec {
+	FILE *fp;		/* underlying file */
+	unsigned int len;	/* length of data following the header */
+	unsigned int type;	/* REC_* */
+};
+
+#define REC_ALIGN 16
+#define REC_SIZE(len) \
+	((sizeof(struct rec) + (len) + REC_ALIGN - 1) & ~(unsigned long) (REC_ALIGN - 1))
+
+struct async_file {
+	FILE *fp;		/* underlying file, owned by the writer */
+	unsigned long lost;	/* lines lost since the last successful write */
+	bool partial;		/* the last enqueued chunk ended mid-line */
+};
+
+static char *ring;
+static unsigned long ring_size;	/* power of 2 */
+static unsigned long ring_head;	/* advanced by the tracer */
+static unsigned long ring_tail;	/* advanced by the writer */
+
+static pthread_t writer;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t tracer_cond = PTHREAD_COND_INITIALIZER;
+static int writer_sleeping, tracer_sleeping, writer_stopping;
+static bool writer_running;
+static int writer_errno;
+
+static int overflow_policy = OUTPUT_OVERFLOW_BLOCK;
+static unsigned long lost_lines, lost_bytes;
+
+#define load(p)		__atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define store(p, v)	__atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+
+static void
+write_all(FILE *fp, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = write(fileno(fp), buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			writer_errno = errno;
+			return;
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+static void
+writev_all(FILE *fp, struct iovec *iov, int cnt)
+{
+	while (cnt) {
+		ssize_t n = writev(fileno(fp), iov, cnt);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			writer_errno = errno;
+			return;
+		}
+		while (cnt && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			++iov;
+			--cnt;
+		}
+		if (cnt) {
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+}
+
+static void *
+writer_thread(void *arg)
+{
+	struct iovec iov[IOV_MAX];
+	unsigned long tail = ring_tail;
+
+	for (;;) {
+		unsigned long head = load(&ring_head);
+		FILE *fp = NULL;
+		int cnt = 0;
+
+		if (head == tail) {
+			pthread_mutex_lock(&ring_lock);
+			store(&writer_sleeping, 1);
+			while (load(&ring_head) == tail && !writer_stopping)
+				pthread_cond_wait(&writer_cond, &ring_lock);
+			store(&writer_sleeping, 0);
+			pthread_mutex_unlock(&ring_lock);
+			if (load(&ring_head) == tail)
+				break;
+			continue;
+		}
+
+		/* Gather consecutive records for the same file */
+		while (tail != head && cnt < IOV_MAX) {
+			struct rec *r = (struct rec *) (ring + (tail & (ring_size - 1)));
+
+			if (r->type == REC_PAD) {
+				tail += r->len;
+				continue;
+			}
+			if (fp && r->fp != fp)
+				break;
+			if (r->type == REC_CLOSE) {
+				if (cnt)
+					break;
+				fclose(r->fp);
+				tail += REC_SIZE(0);
+				continue;
+			}
+			fp = r->fp;
+			iov[cnt].iov_base = r + 1;
+			iov[cnt].iov_len = r->len;
+			++cnt;
+			tail += REC_SIZE(r->len);
+		}
+		if (cnt)
+			writev_all(fp, iov, cnt);
+
+		store(&ring_tail, tail);
+		if (load(&tracer_sleeping)) {
+			pthread_mutex_lock(&ring_lock);
+			pthread_cond_signal(&tracer_cond);
+			pthread_mutex_unlock(&ring_lock);
+		}
+	}
+	return NULL;
+}
+
+/* Wait until the writer makes room for size bytes */
+static void
+wait_for_room(unsigned long size)
+{
+	pthread_mutex_lock(&ring_lock);
+	store(&tracer_sleeping, 1);
+	while (ring_head + size - load(&ring_tail) > ring_size)
+		pthread_cond_wait(&tracer_cond, &ring_lock);
+	store(&tracer_sleeping, 0);
+	pthread_mutex_unlock(&ring_lock);
+}
+
+/*
+ * Append a record to the ring.
+ * Returns 0 if there is no room and the record may be dropped.
+ */
+static int
+enqueue(FILE *fp, unsigned int type, const char *buf, unsigned int len, int may_drop)
+{
+	unsigned long size = REC_SIZE(len);
+	unsigned long off = ring_head & (ring_size - 1);
+	unsigned long pad = off + size > ring_size ? ring_size - off : 0;
+	struct rec *r;
+
+	if (ring_head + pad + size - load(&ring_tail) > ring_size) {
+		if (may_drop)
+			return 0;
+		wait_for_room(pad + size);
+	}
+	if (pad) {
+		r = (struct rec *) (ring + off);
+		r->fp = NULL;
+		r->len = pad;
+		r->type = REC_PAD;
+		off = 0;
+	}
+	r = (struct rec *) (ring + off);
+	r->fp = fp;
+	r->len = len;
+	r->type = type;
+	if (len)
+		memcpy(r + 1, buf, len);
+
+	store(&ring_head, ring_head + pad + size);
+	if (load(&writer_sleeping)) {
+		pthread_mutex_lock(&ring_lock);
+		pthread_cond_signal(&writer_cond);
+		pthread_mutex_unlock(&ring_lock);
+	}
+	return 1;
+}
+
+static unsigned long
+count_lines(const char *buf, size_t len)
+{
+	const char *end = buf + len;
+	unsigned long n = 0;
+
+	while ((buf = memchr(buf, '\n', end - buf)) != NULL) {
+		++n;
+		++buf;
+	}
+	return n;
+}
+
+/*
+ * With OUTPUT_OVERFLOW_COUNT, tell the reader of the log
+ * how many lines are missing before writing anything else.
+ */
+static int
+enqueue_lost_marker(struct async_file *af, int may_drop)
+{
+	char msg[sizeof("\n--- %lu lines lost ---\n") + sizeof(long) * 3];
+	int n = sprintf(msg, "%s--- %lu lines lost ---\n",
+			af->partial ? "\n" : "", af->lost);
+
+	if (!enqueue(af->fp, REC_DATA, msg, n, may_drop))
+		return 0;
+	af->lost = 0;
+	af->partial = false;
+	return 1;
+}
+
+static ssize_t
+async_write(void *cookie, const char *buf, size_t len)
+{
+	struct async_file *af = cookie;
+	/* Large chunks are split so that any chunk fits into the ring */
+	size_t chunk_max = ring_size / 4 - sizeof(struct rec);
+	int may_drop = overflow_policy != OUTPUT_OVERFLOW_BLOCK;
+	size_t done;
+
+	if (!writer_running) {
+		write_all(af->fp, buf, len);
+		return len;
+	}
+
+	for (done = 0; done < len; done += chunk_max) {
+		size_t chunk = len - done;
+
+		if (chunk > chunk_max)
+			chunk = chunk_max;
+		if ((af->lost && !enqueue_lost_marker(af, 1))
+		    || !enqueue(af->fp, REC_DATA, buf + done, chunk, may_drop)) {
+			unsigned long n = count_lines(buf + done, chunk);
+
+			lost_lines += n;
+			lost_bytes += chunk;
+			if (overflow_policy == OUTPUT_OVERFLOW_COUNT)
+				af->lost += n;
+		} else
+			af->partial = buf[done + chunk - 1] != '\n';
+	}
+	return len;
+}
+
+static int
+async_close(void *cookie)
+{
+	struct async_file *af = cookie;
+
+	if (writer_running) {
+		/* Do not let the log end silently truncated */
+		if (af->lost)
+			enqueue_lost_marker(af, 0);
+		enqueue(af->fp, REC_CLOSE, NULL, 0, 0);
+	} else
+		fclose(af->fp);
+	free(af);
+	return 0;
+}
+
+/*
+ * Replace fp with a stream which writes through the ring.
+ * Called before the writer is started, so everything written
+ * before that point is written synchronously.
+ */
+FILE *
+async_output_wrap(FILE *fp)
+{
+	static const cookie_io_functions_t funcs = {
+		.write = async_write,
+		.close = async_close
+	};
+	struct async_file *af;
+	FILE *afp;
+
+	if (!ring_size)
+		return fp;
+
+	af = calloc(1, sizeof(*af));
+	if (!af)
+		die_out_of_memory();
+	af->fp = fp;
+	afp = fopencookie(af, "w", funcs);
+	if (!afp)
+		die_out_of_memory();
+	return afp;
+}
+
+void
+async_output_init(unsigned long size, int policy)
+{
+	unsigned long sz = 4096;
+
+	while (sz < size)
+		sz *= 2;
+	ring = malloc(sz);
+	if (!ring)
+		die_out_of_memory();
+	ring_size = sz;
+	overflow_policy = policy;
+}
+
+void
+async_output_start(void)
+{
+	sigset_t all, old;
+	int err;
+
+	if (!ring_size || writer_running)
+		return;
+
+	/* Signals are for the tracer thread only */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	err = pthread_create(&writer, NULL, writer_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err) {
+		errno = err;
+		perror_msg_and_die("pthread_create");
+	}
+	writer_running = 1;
+}
+
+/* Wait until everything queued so far is written, stop the writer */
+void
+async_output_finish(void)
+{
+	if (!writer_running)
+		return;
+
+	pthread_mutex_lock(&ring_lock);
+	writer_stopping = 1;
+	pthread_cond_signal(&writer_cond);
+	pthread_mutex_unlock(&ring_lock);
+	pthread_join(writer, NULL);
+	writer_running = 0;
+
+	if (writer_errno) {
+		errno = writer_errno;
+		perror_msg("write to output file failed");
+	}
+	if (lost_lines || lost_bytes)
+		error_msg("output buffer overflow: %lu lines (%lu bytes) lost",
+			  lost_lines, lost_bytes);
+}
+
+#else /* !(HAVE_FOPENCOOKIE && HAVE_PTHREAD_H) */
+
+FILE *
+async_output_wrap(FILE *fp)
+{
+	return fp;
+}
+
+void
+async_output_init(unsigned long size, int policy)
+{
+	error_msg_and_die("--output-buffer is not supported by this build of strace");
+}
+
+void
+async_output_start(void)
+{
+}
+
+void
+async_output_finish(void)
+{
+}
+
+#endif
@@ -28,16 +28,190 @@
 
 #include "defs.h"
 #include <sys/param.h>
+#include <fnmatch.h>
 #if defined HAVE_POLL_H
 # include <poll.h>
 #elif defined HAVE_SYS_POLL_H
 # include <sys/poll.h>
 #endif
 
-#include "syscall.h"
+#ifndef AT_FDCWD
+# define AT_FDCWD	-100
+#endif
+
+/*
+ * Paths selected with -P are matched in three ways:
+ * - a path ending with '/' matches everything under this directory
+ *   and the directory itself;
+ * - a path containing wildcards is a glob(7) pattern;
+ * - any other path has to be equal to the path accessed.
+ * Plain paths are kept in a hash set.  Directories are kept in a trie
+ * of path components; its edges are kept in a hash table indexed by
+ * the parent node and the component, so a path is matched with one
+ * lookup per component.  Patterns are tried one by one.
+ */
+bool tracing_paths = 0;
+
+#define FNV_OFFSET	2166136261U
+#define FNV_PRIME	16777619U
+
+static unsigned int
+hash_str(unsigned int h, const char *s, unsigned int len)
+{
+	while (len--)
+		h = (h ^ (unsigned char) *s++) * FNV_PRIME;
+	return h;
+}
+
+static const char **path_set;	/* NULL is an empty slot */
+static unsigned int path_set_size;	/* power of 2 */
+static unsigned int path_set_count;
+
+struct trie_edge {
+	const char *name;	/* not NUL-terminated, NULL is an empty slot */
+	unsigned int len;
+	unsigned int parent;
+	unsigned int child;
+	bool dir_end;		/* a selected directory ends here */
+};
+static struct trie_edge *trie_edges;
+static unsigned int trie_size;	/* power of 2 */
+static unsigned int trie_count;	/* number of edges, node 0 is the root */
+
+static const char **patterns;
+static unsigned int num_patterns;
+
+static const char **
+path_set_slot(const char *path)
+{
+	unsigned int mask = path_set_size - 1;
+	unsigned int i = hash_str(FNV_OFFSET, path, strlen(path)) & mask;
+
+	while (path_set[i] && strcmp(path_set[i], path) != 0)
+		i = (i + 1) & mask;
+	return &path_set[i];
+}
+
+static void
+path_set_add(const char *path)
+{
+	const char **slot;
+
+	if (2 * (path_set_count + 1) > path_set_size) {
+		const char **old = path_set;
+		unsigned int i, old_size = path_set_size;
+
+		path_set_size = old_size ? 2 * old_size : 64;
+		path_set = calloc(path_set_size, sizeof(path_set[0]));
+		if (!path_set)
+			die_out_of_memory();
+		for (i = 0; i < old_size; ++i)
+			if (old[i])
+				*path_set_slot(old[i]) = old[i];
+		free(old);
+	}
+	slot = path_set_slot(path);
+	if (!*slot) {
+		*slot = path;
+		path_set_count++;
+	}
+}
+
+static struct trie_edge *
+trie_slot(unsigned int parent, const char *name, unsigned int len)
+{
+	unsigned int mask = trie_size - 1;
+	unsigned int i = hash_str(FNV_OFFSET ^ parent, name, len) & mask;
+	struct trie_edge *e;
+
+	for (;; i = (i + 1) & mask) {
+		e = &trie_edges[i];
+		if (!e->name || (e->parent == parent && e->len == len
+				 && memcmp(e->name, name, len) == 0))
+			return e;
+	}
+}
+
+static struct trie_edge *
+trie_add_edge(unsigned int parent, const char *name, unsigned int len)
+{
+	struct trie_edge *e;
+
+	if (2 * (trie_count + 1) > trie_size) {
+		struct trie_edge *old = trie_edges;
+		unsigned int i, old_size = trie_size;
+
+		trie_size = old_size ? 2 * old_size : 64;
+		trie_edges = calloc(trie_size, sizeof(trie_edges[0]));
+		if (!trie_edges)
+			die_out_of_memory();
+		for (i = 0; i < old_size; ++i)
+			if (old[i].name)
+				*trie_slot(old[i].parent, old[i].name,
+					   old[i].len) = old[i];
+		free(old);
+	}
+	e = trie_slot(parent, name, len);
+	if (!e->name) {
+		e->name = name;
+		e->len = len;
+		e->parent = parent;
+		e->child = ++trie_count;
+	}
+	return e;
+}
+
+/*
+ * Add directory dir, len bytes long, without the trailing '/'.
+ * "" stands for the root directory.
+ */
+static void
+trie_add(const char *dir, unsigned int len)
+{
+	const char *end = dir + len, *p;
+	struct trie_edge *e;
+	unsigned int node = 0;
+
+	for (;;) {
+		p = memchr(dir, '/', end - dir);
+		if (!p)
+			p = end;
+		e = trie_add_edge(node, dir, p - dir);
+		if (p == end)
+			break;
+		node = e->child;
+		dir = p + 1;
+	}
+	e->dir_end = 1;
+}
 
-const char **paths_selected = NULL;
-static unsigned num_selected = 0;
+/*
+ * Return true if path is under one of the selected directories.
+ */
+static int
+trie_match(const char *path)
+{
+	struct trie_edge *e;
+	unsigned int node = 0;
+	const char *p;
+
+	if (!trie_count)
+		return 0;
+	for (;;) {
+		p = strchr(path, '/');
+		if (!p)
+			p = path + strlen(path);
+		e = trie_slot(node, path, p - path);
+		if (!e->name)
+			return 0;
+		if (e->dir_end)
+			return 1;
+		if (!*p)
+			return 0;
+		node = e->child;
+		path = p + 1;
+	}
+}
 
 /*
  * Return true if specified path matches one that we're tracing.
@@ -45,71 +219,148 @@ static unsigned num_selected = 0;
 static int
 pathmatch(const char *path)
 {
-	unsigned i;
-
-	for (i = 0; i < num_selected; ++i) {
-		if (strcmp(path, paths_selected[i]) == 0)
+	unsigned int i;
+
+	if (path_set_count && *path_set_slot(path))
+		return 1;
+	if (trie_match(path))
+		return 1;
+	for (i = 0; i < num_patterns; ++i) {
+		if (fnmatch(patterns[i], path, FNM_PATHNAME) == 0)
 			return 1;
 	}
 	return 0;
 }
 
 /*
- * Return true if specified path (in user-space) matches.
+ * Get current directory of tcp.
  */
 static int
-upathmatch(struct tcb *tcp, unsigned long upath)
+getcwdpath(struct tcb *tcp, char *buf, unsigned bufsize)
 {
-	char path[PATH_MAX + 1];
+	int n;
+
+	/* The capture keeps it as the path of AT_FDCWD */
+	if (capture_decoding)
+		return capture_get_fdpath(AT_FDCWD, buf, bufsize);
+
+	if (fdcache_enabled)
+		n = fdcache_getcwd(tcp, buf, bufsize);
+	else
+		n = readfdpath(tcp->pid, AT_FDCWD, buf, bufsize);
+	if (capture_enabled)
+		capture_put_fdpath(AT_FDCWD, n, buf);
+	return n;
+}
 
-	return umovestr(tcp, upath, sizeof path, path) > 0 &&
-		pathmatch(path);
+/*
+ * Store path, relative to directory dir unless it is absolute,
+ * as an absolute path without ".", "..", and empty components in buf.
+ * ".." just removes the previous component, as if there were
+ * no symbolic links.  Returns false if the result does not fit.
+ */
+static bool
+normalize_path(char *buf, unsigned bufsize, const char *dir, const char *path)
+{
+	const char *src[2] = { path[0] == '/' ? "" : dir, path };
+	const char *p, *end;
+	unsigned int i, n, len = 0;
+
+	for (i = 0; i < 2; ++i) {
+		for (p = src[i]; *p; p = end) {
+			while (*p == '/')
+				++p;
+			end = strchr(p, '/');
+			if (!end)
+				end = p + strlen(p);
+			n = end - p;
+			if (n == 0 || (n == 1 && p[0] == '.'))
+				continue;
+			if (n == 2 && p[0] == '.' && p[1] == '.') {
+				while (len && buf[--len] != '/')
+					;
+				continue;
+			}
+			if (len + 1 + n >= bufsize)
+				return 0;
+			buf[len++] = '/';
+			memcpy(buf + len, p, n);
+			len += n;
+		}
+	}
+	if (!len)
+		buf[len++] = '/';
+	buf[len] = '\0';
+	return 1;
 }
 
 /*
- * Return true if specified fd maps to a path we're tracing.
+ * Return true if specified path (in user-space) matches,
+ * either as is, or resolved relative to directory dirfd.
  */
 static int
-fdmatch(struct tcb *tcp, int fd)
+upathmatch_at(struct tcb *tcp, int dirfd, unsigned long upath)
 {
 	char path[PATH_MAX + 1];
-	int n = getfdpath(tcp, fd, path, sizeof(path));
+	char dir[PATH_MAX + 1];
+	char abspath[PATH_MAX + 1];
+	int n;
 
-	return n >= 0 && pathmatch(path);
+	if (umovestr(tcp, upath, sizeof path, path) <= 0)
+		return 0;
+	if (pathmatch(path))
+		return 1;
+
+	if (path[0] != '/') {
+		if (dirfd == AT_FDCWD)
+			n = getcwdpath(tcp, dir, sizeof(dir));
+		else
+			n = getfdpath(tcp, dirfd, dir, sizeof(dir));
+		/* Not a directory, or one we cannot see */
+		if (n <= 0 || dir[0] != '/')
+			return 0;
+	}
+	return normalize_path(abspath, sizeof(abspath), dir, path) &&
+		strcmp(abspath, path) != 0 &&
+		pathmatch(abspath);
 }
 
 /*
- * Add a path to the set we're tracing.
- * Specifying NULL will delete all paths.
+ * Return true if specified path (in user-space) matches,
+ * resolving it relative to the current directory.
  */
-static void
-storepath(const char *path)
+static int
+upathmatch(struct tcb *tcp, unsigned long upath)
 {
-	unsigned i;
+	return upathmatch_at(tcp, AT_FDCWD, upath);
+}
 
-	if (pathmatch(path))
-		return; /* already in table */
+/*
+ * Return true if specified fd maps to a path we're tracing.
+ */
+static int
+fdmatch(struct tcb *tcp, int fd)
+{
+	char path[PATH_MAX + 1];
+	int n = getfdpath(tcp, fd, path, sizeof(path));
 
-	i = num_selected++;
-	paths_selected = realloc(paths_selected, num_selected * sizeof(paths_selected[0]));
-	if (!paths_selected)
-		die_out_of_memory();
-	paths_selected[i] = path;
+	return n >= 0 && pathmatch(path);
 }
 
 /*
- * Get path associated with fd.
+ * Read path associated with fd of process pid from /proc.
+ * AT_FDCWD stands for the current directory.
  */
 int
-getfdpath(struct tcb *tcp, int fd, char *buf, unsigned bufsize)
+readfdpath(int pid, int fd, char *buf, unsigned bufsize)
 {
 	char linkpath[sizeof("/proc/%u/fd/%u") + 2 * sizeof(int)*3];
 	ssize_t n;
 
-	if (fd < 0)
-		return -1;
-
-	sprintf(linkpath, "/proc/%u/fd/%u", tcp->pid, fd);
+	if (fd == AT_FDCWD)
+		sprintf(linkpath, "/proc/%u/cwd", pid);
+	else
+		sprintf(linkpath, "/proc/%u/fd/%u", pid, fd);
 	n = readlink(linkpath, buf, bufsize - 1);
 	/*
 	 * NB: if buf is too small, readlink doesn't fail,
@@ -121,251 +372,243 @@ getfdpath(struct tcb *tcp, int fd, char *buf, unsigned bufsize)
 }
 
 /*
- * Add a path to the set we're tracing.  Also add the canonicalized
- * version of the path.  Secifying NULL will delete all paths.
+ * Get path associated with fd.
  */
-void
-pathtrace_select(const char *path)
+int
+getfdpath(struct tcb *tcp, int fd, char *buf, unsigned bufsize)
+{
+	int n;
+
+	if (fd < 0)
+		return -1;
+	if (capture_decoding)
+		return capture_get_fdpath(fd, buf, bufsize);
+
+	if (fdcache_enabled)
+		n = fdcache_getpath(tcp, fd, buf, bufsize);
+	else
+		n = readfdpath(tcp->pid, fd, buf, bufsize);
+	if (capture_enabled)
+		capture_put_fdpath(fd, n, buf);
+	return n;
+}
+
+/*
+ * Add a path, a directory, or a pattern to the set we're tracing.
+ * Also add the canonicalized version of the path or directory.
+ */
+static void
+select_path(const char *path, bool verbose)
 {
+	size_t len = strlen(path), rlen;
 	char *rpath;
 
-	storepath(path);
+	if (!len)
+		return;
+	tracing_paths = 1;
 
-	rpath = realpath(path, NULL);
+	if (strpbrk(path, "*?[")) {
+		patterns = realloc(patterns, (num_patterns + 1) * sizeof(patterns[0]));
+		if (!patterns)
+			die_out_of_memory();
+		patterns[num_patterns++] = path;
+		return;
+	}
 
+	if (path[len - 1] == '/') {
+		while (len && path[len - 1] == '/')
+			--len;
+		trie_add(path, len);
+	} else
+		path_set_add(path);
+
+	rpath = realpath(path, NULL);
 	if (rpath == NULL)
 		return;
+	/* The root directory is "" in the trie */
+	rlen = strcmp(rpath, "/") ? strlen(rpath) : 0;
 
 	/* if realpath and specified path are same, we're done */
-	if (strcmp(path, rpath) == 0) {
+	if (rlen == len && strncmp(path, rpath, len) == 0) {
 		free(rpath);
 		return;
 	}
 
-	fprintf(stderr, "Requested path '%s' resolved into '%s'\n",
-		path, rpath);
-	storepath(rpath);
+	if (verbose)
+		fprintf(stderr, "Requested path '%s' resolved into '%s'\n",
+			path, rpath);
+	if (path[len] == '/')
+		trie_add(rpath, rlen);
+	else
+		path_set_add(rpath);
 }
 
 /*
- * Return true if syscall accesses a selected path
- * (or if no paths have been specified for tracing).
+ * Select paths listed in file, one per line.
  */
-int
-pathtrace_match(struct tcb *tcp)
+static void
+select_path_file(const char *file)
+{
+	char buf[PATH_MAX + 2];
+	unsigned int lineno = 0;
+	size_t len;
+	char *path;
+	FILE *fp;
+
+	fp = fopen(file, "r");
+	if (!fp)
+		perror_msg_and_die("Can't fopen '%s'", file);
+	while (fgets(buf, sizeof(buf), fp)) {
+		++lineno;
+		len = strlen(buf);
+		if (len && buf[len - 1] == '\n')
+			buf[--len] = '\0';
+		else if (!feof(fp))
+			error_msg_and_die("%s:%u: path is too long", file, lineno);
+		if (!len)
+			continue;
+		path = strdup(buf);
+		if (!path)
+			die_out_of_memory();
+		select_path(path, 0);
+	}
+	if (ferror(fp))
+		perror_msg_and_die("Can't read '%s'", file);
+	fclose(fp);
+}
+
+/*
+ * Add a path to the set we're tracing.
+ * "@file" adds every path listed in file.
+ */
+void
+pathtrace_select(const char *path)
 {
-	const struct_sysent *s;
+	if (path[0] == '@')
+		select_path_file(path + 1);
+	else
+		select_path(path, 1);
+}
 
-	s = tcp->s_ent;
+/*
+ * Return true if any fd below nfds in the fd_set at addr
+ * maps to a path we're tracing.
+ */
+static int
+fdsetmatch(struct tcb *tcp, int nfds, long addr)
+{
+	unsigned fdsize;
+	fd_set *fds;
+	int     j;
 
-	if (!(s->sys_flags & (TRACE_FILE | TRACE_DESC | TRACE_NETWORK)))
+	/* Kernel rejects negative nfds, so we don't parse it either. */
+	if (nfds <= 0 || addr == 0)
 		return 0;
+	/* Beware of select(2^31-1, NULL, NULL, NULL) and similar... */
+	if (nfds > 1024*1024)
+		nfds = 1024*1024;
+	fdsize = (((nfds + 7) / 8) + current_wordsize-1) & -current_wordsize;
+	fds = malloc(fdsize);
+	if (!fds)
+		die_out_of_memory();
 
-	/*
-	 * Check for special cases where we need to do something
-	 * other than test arg[0].
-	 */
-
-	if (s->sys_func == sys_dup2 ||
-	    s->sys_func == sys_dup3 ||
-	    s->sys_func == sys_sendfile ||
-	    s->sys_func == sys_sendfile64 ||
-	    s->sys_func == sys_tee)
-	{
-		/* fd, fd */
-		return fdmatch(tcp, tcp->u_arg[0]) ||
-			fdmatch(tcp, tcp->u_arg[1]);
+	if (umoven(tcp, addr, fdsize, (char *) fds) < 0) {
+		fprintf(stderr, "umoven() failed\n");
+		free(fds);
+		return 0;
 	}
-
-	if (s->sys_func == sys_inotify_add_watch ||
-	    s->sys_func == sys_faccessat ||
-	    s->sys_func == sys_fchmodat ||
-	    s->sys_func == sys_futimesat ||
-	    s->sys_func == sys_mkdirat ||
-	    s->sys_func == sys_unlinkat ||
-	    s->sys_func == sys_newfstatat ||
-	    s->sys_func == sys_mknodat ||
-	    s->sys_func == sys_openat ||
-	    s->sys_func == sys_readlinkat ||
-	    s->sys_func == sys_utimensat ||
-	    s->sys_func == sys_fchownat ||
-	    s->sys_func == sys_pipe2)
-	{
-		/* fd, path */
-		return fdmatch(tcp, tcp->u_arg[0]) ||
-			upathmatch(tcp, tcp->u_arg[1]);
+	for (j = 0;; j++) {
+		j = next_set_bit(fds, j, nfds);
+		if (j < 0)
+			break;
+		if (fdmatch(tcp, j)) {
+			free(fds);
+			return 1;
+		}
 	}
+	free(fds);
+	return 0;
+}
 
-	if (s->sys_func == sys_link ||
-	    s->sys_func == sys_mount)
-	{
-		/* path, path */
-		return upathmatch(tcp, tcp->u_arg[0]) ||
-			upathmatch(tcp, tcp->u_arg[1]);
-	}
+/*
+ * Return true if any of nfds pollfds at start
+ * refers to a path we're tracing.
+ */
+static int
+pollfdmatch(struct tcb *tcp, unsigned long start, unsigned nfds)
+{
+	struct pollfd fds;
+	unsigned long cur, end;
 
-	if (s->sys_func == sys_quotactl)
-	{
-		/* x, path */
-		return upathmatch(tcp, tcp->u_arg[1]);
-	}
+	end = start + sizeof(fds) * nfds;
 
-	if (s->sys_func == sys_renameat ||
-	    s->sys_func == sys_linkat)
-	{
-		/* fd, path, fd, path */
-		return fdmatch(tcp, tcp->u_arg[0]) ||
-			fdmatch(tcp, tcp->u_arg[2]) ||
-			upathmatch(tcp, tcp->u_arg[1]) ||
-			upathmatch(tcp, tcp->u_arg[3]);
-	}
+	if (nfds == 0 || end < start)
+		return 0;
 
-	if (
-	    s->sys_func == sys_old_mmap ||
-#if defined(S390)
-	    s->sys_func == sys_old_mmap_pgoff ||
-#endif
-	    s->sys_func == sys_mmap ||
-	    s->sys_func == sys_mmap_pgoff ||
-	    s->sys_func == sys_mmap_4koff
-	) {
-		/* x, x, x, x, fd */
-		return fdmatch(tcp, tcp->u_arg[4]);
-	}
+	for (cur = start; cur < end; cur += sizeof(fds))
+		if ((umoven(tcp, cur, sizeof fds, (char *) &fds) == 0)
+		    && fdmatch(tcp, fds.fd))
+			return 1;
 
-	if (s->sys_func == sys_symlinkat) {
-		/* path, fd, path */
-		return fdmatch(tcp, tcp->u_arg[1]) ||
-			upathmatch(tcp, tcp->u_arg[0]) ||
-			upathmatch(tcp, tcp->u_arg[2]);
-	}
+	return 0;
+}
 
-	if (s->sys_func == sys_splice) {
-		/* fd, x, fd, x, x */
-		return fdmatch(tcp, tcp->u_arg[0]) ||
-			fdmatch(tcp, tcp->u_arg[2]);
-	}
+/*
+ * Return true if syscall accesses a selected path
+ * (or if no paths have been specified for tracing).
+ */
+int
+pathtrace_match(struct tcb *tcp)
+{
+	const char *roles;
+	long    oldargs[5];
+	int     dirfd = AT_FDCWD;
+	int     i;
 
-	if (s->sys_func == sys_epoll_ctl) {
-		/* x, x, fd, x */
-		return fdmatch(tcp, tcp->u_arg[2]);
-	}
+	if (!(tcp->s_ent->sys_flags & (TRACE_FILE | TRACE_DESC | TRACE_NETWORK)))
+		return 0;
 
-	if (s->sys_func == sys_fanotify_mark) {
-		/* x, x, x, fd, path */
-		return fdmatch(tcp, tcp->u_arg[3]) ||
-			upathmatch(tcp, tcp->u_arg[4]);
-	}
+	roles = syscall_arg_roles(tcp);
+	for (i = 0; roles[i]; i++) {
+		long arg = tcp->u_arg[i];
 
-	if (s->sys_func == sys_select ||
-	    s->sys_func == sys_oldselect ||
-	    s->sys_func == sys_pselect6)
-	{
-		int     i, j;
-		int     nfds;
-		long   *args, oldargs[5];
-		unsigned fdsize;
-		fd_set *fds;
-
-		args = tcp->u_arg;
-		if (s->sys_func == sys_oldselect) {
-			if (umoven(tcp, tcp->u_arg[0], sizeof oldargs,
-				   (char*) oldargs) < 0)
+		switch (roles[i]) {
+		case 'f':
+			if (fdmatch(tcp, arg))
+				return 1;
+			dirfd = arg;
+			break;
+		case 'p':
+			if (upathmatch(tcp, arg))
+				return 1;
+			break;
+		case 'a':
+			if (upathmatch_at(tcp, dirfd, arg))
+				return 1;
+			break;
+		case 's':
+			/* Kernel truncates arg[0] to int, we do the same. */
+			if (fdsetmatch(tcp, (int) tcp->u_arg[0], arg))
+				return 1;
+			break;
+		case 'S':
+			if (umoven(tcp, arg, sizeof oldargs,
+				   (char *) oldargs) < 0)
 			{
 				fprintf(stderr, "umoven() failed\n");
 				return 0;
 			}
-			args = oldargs;
-		}
-
-		/* Kernel truncates arg[0] to int, we do the same. */
-		nfds = (int) args[0];
-		/* Kernel rejects negative nfds, so we don't parse it either. */
-		if (nfds <= 0)
-			return 0;
-		/* Beware of select(2^31-1, NULL, NULL, NULL) and similar... */
-		if (nfds > 1024*1024)
-			nfds = 1024*1024;
-		fdsize = (((nfds + 7) / 8) + current_wordsize-1) & -current_wordsize;
-		fds = malloc(fdsize);
-		if (!fds)
-			die_out_of_memory();
-
-		for (i = 1; i <= 3; ++i) {
-			if (args[i] == 0)
-				continue;
-			if (umoven(tcp, args[i], fdsize, (char *) fds) < 0) {
-				fprintf(stderr, "umoven() failed\n");
-				continue;
-			}
-			for (j = 0;; j++) {
-				j = next_set_bit(fds, j, nfds);
-				if (j < 0)
-					break;
-				if (fdmatch(tcp, j)) {
-					free(fds);
-					return 1;
-				}
-			}
-		}
-		free(fds);
-		return 0;
-	}
-
-	if (s->sys_func == sys_poll ||
-	    s->sys_func == sys_ppoll)
-	{
-		struct pollfd fds;
-		unsigned nfds;
-		unsigned long start, cur, end;
-
-		start = tcp->u_arg[0];
-		nfds = tcp->u_arg[1];
-
-		end = start + sizeof(fds) * nfds;
-
-		if (nfds == 0 || end < start)
-			return 0;
-
-		for (cur = start; cur < end; cur += sizeof(fds))
-			if ((umoven(tcp, cur, sizeof fds, (char *) &fds) == 0)
-			    && fdmatch(tcp, fds.fd))
+			if (fdsetmatch(tcp, (int) oldargs[0], oldargs[1]) ||
+			    fdsetmatch(tcp, (int) oldargs[0], oldargs[2]) ||
+			    fdsetmatch(tcp, (int) oldargs[0], oldargs[3]))
 				return 1;
-
-		return 0;
-	}
-
-	if (s->sys_func == printargs ||
-	    s->sys_func == sys_pipe ||
-	    s->sys_func == sys_pipe2 ||
-	    s->sys_func == sys_eventfd2 ||
-	    s->sys_func == sys_eventfd ||
-	    s->sys_func == sys_inotify_init1 ||
-	    s->sys_func == sys_timerfd_create ||
-	    s->sys_func == sys_timerfd_settime ||
-	    s->sys_func == sys_timerfd_gettime ||
-	    s->sys_func == sys_epoll_create ||
-	    s->sys_func == sys_socket ||
-	    s->sys_func == sys_socketpair ||
-	    s->sys_func == sys_fanotify_init)
-	{
-		/*
-		 * These have TRACE_FILE or TRACE_DESCRIPTOR or TRACE_NETWORK set,
-		 * but they don't have any file descriptor or path args to test.
-		 */
-		return 0;
+			break;
+		case 'P':
+			if (pollfdmatch(tcp, arg, tcp->u_arg[i + 1]))
+				return 1;
+			break;
+		}
 	}
 
-	/*
-	 * Our fallback position for calls that haven't already
-	 * been handled is to just check arg[0].
-	 */
-
-	if (s->sys_flags & TRACE_FILE)
-		return upathmatch(tcp, tcp->u_arg[0]);
-
-	if (s->sys_flags & (TRACE_DESC | TRACE_NETWORK))
-		return fdmatch(tcp, tcp->u_arg[0]);
-
 	return 0;
 }
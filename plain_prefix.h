@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2014 The strace developers.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Return the number of leading bytes of `ustr' which are printed as is
+ * by string_quote(): printable ASCII other than '"' and '\\'.
+ *
+ * There is no include guard: tests/plain-prefix.c includes this
+ * a second time with __SSE2__ undefined, to compare both versions.
+ */
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+static int
+plain_prefix(const unsigned char *ustr, int size)
+{
+	int i = 0, c;
+
+#ifdef __SSE2__
+	/* Check 16 bytes at a time, as signed bytes 0x80..0xff are < ' ' */
+	const __m128i below = _mm_set1_epi8(' ' - 1);
+	const __m128i above = _mm_set1_epi8(0x7f);
+	const __m128i quote = _mm_set1_epi8('\"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+
+	for (; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (ustr + i));
+		__m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, below),
+					   _mm_cmplt_epi8(v, above));
+		__m128i bad = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+					   _mm_cmpeq_epi8(v, backslash));
+		unsigned int mask = _mm_movemask_epi8(_mm_andnot_si128(bad, ok));
+
+		if (mask != 0xffff)
+			return i + __builtin_ctz(~mask);
+	}
+#endif
+	for (; i < size; ++i) {
+		c = ustr[i];
+		if (c < ' ' || c > 0x7e || c == '\"' || c == '\\')
+			break;
+	}
+	return i;
+}
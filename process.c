@@ -105,7 +105,7 @@
 #ifdef HAVE_PRCTL
 # include <sys/prctl.h>
 
-static const struct xlat prctl_options[] = {
+const struct xlat prctl_options[] = {
 #ifdef PR_MAXPROCS
 	XLAT(PR_MAXPROCS),
 #endif
@@ -911,30 +911,46 @@ sys_getgroups32(struct tcb *tcp)
 static void
 printargv(struct tcb *tcp, long addr)
 {
+	unsigned long cp;
+	/*
+	 * Pointers are fetched in batches.  The batch does not cross
+	 * the page of the pointer needed now, so reading ahead of
+	 * the terminating NULL cannot fail where reading it would not.
+	 */
 	union {
-		unsigned int p32;
-		unsigned long p64;
-		char data[sizeof(long)];
-	} cp;
+		unsigned int p32[16];
+		unsigned long p64[16];
+	} buf;
+	unsigned int nbuf = 0, ibuf = 0, cnt;
 	const char *sep;
 	int n = 0;
 	unsigned wordsize = current_wordsize;
 
-	cp.p64 = 1;
+	cp = 1;
 	for (sep = ""; !abbrev(tcp) || n < max_strlen / 2; sep = ", ", ++n) {
-		if (umoven(tcp, addr, wordsize, cp.data) < 0) {
+		if (ibuf == nbuf) {
+			ibuf = 0;
+			cnt = (4096 - (addr & 4095)) / wordsize;
+			if (cnt == 0)
+				cnt = 1;
+			nbuf = umove_array(tcp, addr, wordsize,
+					   MIN(cnt, ARRAY_SIZE(buf.p32)), &buf);
+		}
+		if (ibuf == nbuf) {
 			tprintf("%#lx", addr);
 			return;
 		}
 		if (wordsize == 4)
-			cp.p64 = cp.p32;
-		if (cp.p64 == 0)
+			cp = buf.p32[ibuf++];
+		else
+			cp = buf.p64[ibuf++];
+		if (cp == 0)
 			break;
 		tprints(sep);
-		printstr(tcp, cp.p64, -1);
+		printstr(tcp, cp, -1);
 		addr += wordsize;
 	}
-	if (cp.p64)
+	if (cp)
 		tprintf("%s...", sep);
 }
 
@@ -2687,7 +2703,7 @@ sys_ptrace(struct tcb *tcp)
 #ifndef FUTEX_CMP_REQUEUE_PI_PRIVATE
 # define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | FUTEX_PRIVATE_FLAG)
 #endif
-static const struct xlat futexops[] = {
+const struct xlat futexops[] = {
 	XLAT(FUTEX_WAIT),
 	XLAT(FUTEX_WAKE),
 	XLAT(FUTEX_FD),
@@ -39,6 +39,7 @@
 #include <grp.h>
 #include <dirent.h>
 #include <sys/utsname.h>
+#include <getopt.h>
 #ifdef HAVE_PRCTL
 # include <sys/prctl.h>
 #endif
@@ -136,11 +137,22 @@ static int exit_code = 0;
 static int strace_child = 0;
 static int strace_tracer_pid = 0;
 
+/*
+ * --tracers=N: the tracees given by -p are split between N tracer
+ * processes.  The first tracer is the parent of the other ones,
+ * it waits for them and forwards fatal signals to them.
+ */
+unsigned int ntracers = 1;
+static int *tracer_pids;
+static unsigned int ntracer_pids;
+
 static char *username = NULL;
 static uid_t run_uid;
 static gid_t run_gid;
 
 unsigned int max_strlen = DEFAULT_STRLEN;
+/* --dump-limit: bytes dumped by -e read/write per syscall, 0 is no limit */
+unsigned long dump_limit = 0;
 static int acolumn = DEFAULT_ACOLUMN;
 static char *acolumn_spaces;
 
@@ -150,9 +162,18 @@ static FILE *shared_log;
 
 struct tcb *printing_tcp = NULL;
 static struct tcb *current_tcp;
+/* Assemble every line in tcp->linebuf, unless --unfinished is given */
+bool assemble_lines = 0;
+static bool print_unfinished = 0;
 
 static struct tcb **tcbtab;
 static unsigned int nprocs, tcbtabsize;
+/* Unused tcbs, linked through tcb->next */
+static struct tcb *free_tcbs;
+/* Used tcbs hashed by pid, linked through tcb->next */
+static struct tcb **pidtab;
+static unsigned int pidtab_mask;
+#define pid_hash(pid) ((unsigned int) (pid) & pidtab_mask)
 static const char *progname;
 
 unsigned os_release; /* generated from uname()'s u.release */
@@ -194,12 +215,15 @@ usage(FILE *ofp, int exitval)
 {
 	fprintf(ofp, "\
 usage: strace [-CdffhiqrtttTvVxxy] [-I n] [-e expr]...\n\
-              [-a column] [-o file] [-s strsize] [-P path]...\n\
+              [-a column] [-o file] [-s strsize] [-P path]... [--seccomp-bpf]\n\
               -p pid... / [-D] [-E var=val]... [-u username] PROG [ARGS]\n\
-   or: strace -c[df] [-I n] [-e expr]... [-O overhead] [-S sortby]\n\
+   or: strace -c[dfw] [-I n] [-e expr]... [-O overhead] [-S sortby]\n\
               -p pid... / [-D] [-E var=val]... [-u username] PROG [ARGS]\n\
+   or: strace --decode=file [-rtttTvxxy] [-a column] [-o file] [-s strsize]\n\
+              [-e expr]... [-P path]...\n\
 -c -- count time, calls, and errors for each syscall and report summary\n\
 -C -- like -c but also print regular output\n\
+-w -- with -c, count wall clock time instead of system time\n\
 -d -- enable debug output to stderr\n\
 -D -- run tracer process as a detached grandchild, not as parent\n\
 -f -- follow forks, -ff -- with output into separate files\n\
@@ -229,7 +253,22 @@ usage: strace [-CdffhiqrtttTvVxxy] [-I n] [-e expr]...\n\
 -u username -- run command as username handling setuid and/or setgid\n\
 -E var=val -- put var=val in the environment for command\n\
 -E var -- remove var from the environment for command\n\
--P path -- trace accesses to path\n\
+-P path -- trace accesses to path, dir/ to anything under dir, or to a glob\n\
+-P @file -- trace accesses to paths listed in file\n\
+--seccomp-bpf -- stop only on traced syscalls using seccomp-bpf (implies -f)\n\
+--tracers=N -- split -p PIDs (and their threads, with -f) between N tracers\n\
+--output-buffer=SIZE -- write -o output from a SIZE bytes buffer in background\n\
+--output-overflow=block|drop|count -- what to do when this buffer is full\n\
+--unfinished -- with -f, print syscalls interrupted by other output in parts\n\
+--binary -- write -o output as a binary capture, decode it later with --decode\n\
+--decode=FILE -- print the trace captured in FILE\n\
+--fd-cache=on|off|check -- cache paths printed by -y and matched by -P\n\
+--dump-limit=SIZE -- dump at most SIZE bytes per syscall with -e read/write\n\
+--latency -- with -c, also report percentiles of the time of each syscall\n\
+--latency=histogram -- and print a histogram of them\n\
+--interval=N -- with -c, also print a summary of the last N seconds every N\n\
+--summary-by=process|thread -- with -c, also summarize every process or thread\n\
+--summary-top=N -- list and summarize only the N busiest ones (default 10)\n\
 "
 /* ancient, no one should use it
 -F -- attempt to follow vforks (deprecated, use -f)\n\
@@ -247,6 +286,7 @@ static void die(void)
 	if (strace_tracer_pid == getpid()) {
 		cflag = 0;
 		cleanup();
+		async_output_finish();
 	}
 	exit(1);
 }
@@ -329,6 +369,27 @@ error_opt_arg(int opt, const char *arg)
 	error_msg_and_die("Invalid -%c argument: '%s'", opt, arg);
 }
 
+/* Parse SIZE[k|m], return 0 on error */
+static unsigned long
+string_to_size(const char *str)
+{
+	char *end;
+	unsigned long value;
+
+	errno = 0;
+	value = strtoul(str, &end, 10);
+	if (errno || end == str)
+		return 0;
+	if (*end == 'k' || *end == 'K') {
+		value <<= 10;
+		++end;
+	} else if (*end == 'm' || *end == 'M') {
+		value <<= 20;
+		++end;
+	}
+	return *end ? 0 : value;
+}
+
 #if USE_SEIZE
 static int
 ptrace_attach_or_seize(int pid)
@@ -359,6 +420,7 @@ ptrace_restart(int op, struct tcb *tcp, int sig)
 	int err;
 	const char *msg;
 
+	umove_cache_invalidate();
 	errno = 0;
 	ptrace(op, tcp->pid, (void *) 0, (long) sig);
 	err = errno;
@@ -467,11 +529,61 @@ strace_fopen(const char *path)
 		perror_msg_and_die("Can't fopen '%s'", path);
 	swap_uid();
 	set_cloexec_flag(fileno(fp));
-	return fp;
+	return async_output_wrap(fp);
 }
 
 static int popen_pid = 0;
 
+/*
+ * --interval=N: a child process which sleeps until the next summary is
+ * due and exits, so that wait4 in trace() returns then even if no tracee
+ * stops, without a timer or a signal to check on every stop.
+ */
+static unsigned int summary_interval;
+static int interval_pid;
+static uint64_t interval_last, interval_deadline;
+
+static void
+start_interval_child(void)
+{
+	uint64_t now = monotonic_ns(), step = summary_interval * 1000000000ULL;
+	struct timespec ts;
+	int pid;
+
+	if (!interval_deadline)
+		interval_deadline = interval_last = now;
+	/* Skip the summaries missed while stopped, e.g. by ^Z */
+	do
+		interval_deadline += step;
+	while (interval_deadline <= now);
+	ts.tv_sec = (interval_deadline - now) / 1000000000;
+	ts.tv_nsec = (interval_deadline - now) % 1000000000;
+
+	pid = fork();
+	if (pid < 0)
+		perror_msg_and_die("fork");
+	if (pid == 0) {
+#if defined HAVE_PRCTL && defined PR_SET_PDEATHSIG
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+		while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+			;
+		_exit(0);
+	}
+	interval_pid = pid;
+}
+
+static void
+stop_interval_child(void)
+{
+	if (!interval_pid)
+		return;
+	kill(interval_pid, SIGKILL);
+	while (waitpid(interval_pid, NULL, 0) < 0 && errno == EINTR)
+		;
+	interval_pid = 0;
+}
+
 #ifndef _PATH_BSHELL
 # define _PATH_BSHELL "/bin/sh"
 #endif
@@ -517,7 +629,51 @@ strace_popen(const char *command)
 	fp = fdopen(fds[1], "w");
 	if (!fp)
 		die_out_of_memory();
-	return fp;
+	return async_output_wrap(fp);
+}
+
+/* Make room for len more bytes and the NUL in tcp->linebuf */
+static void
+linebuf_reserve(struct tcb *tcp, unsigned int len)
+{
+	unsigned int need = tcp->curcol + len + 1;
+	unsigned int size = tcp->linebuf_size ? tcp->linebuf_size : 256;
+
+	if (need <= tcp->linebuf_size)
+		return;
+	while (size < need)
+		size *= 2;
+	tcp->linebuf = realloc(tcp->linebuf, size);
+	if (!tcp->linebuf)
+		die_out_of_memory();
+	tcp->linebuf_size = size;
+}
+
+static void
+linebuf_vprintf(struct tcb *tcp, const char *fmt, va_list args)
+{
+	va_list copy;
+	int n;
+
+	va_copy(copy, args);
+	n = vsnprintf(tcp->linebuf + tcp->curcol,
+		      tcp->linebuf_size - tcp->curcol, fmt, copy);
+	va_end(copy);
+	if (n < 0)
+		return;
+	if (tcp->curcol + n >= tcp->linebuf_size) {
+		linebuf_reserve(tcp, n);
+		vsnprintf(tcp->linebuf + tcp->curcol, n + 1, fmt, args);
+	}
+	tcp->curcol += n;
+}
+
+/* Write out the part of the line assembled so far */
+static void
+linebuf_flush(struct tcb *tcp)
+{
+	if (assemble_lines && tcp->curcol != 0)
+		fwrite_unlocked(tcp->linebuf, 1, tcp->curcol, tcp->outf);
 }
 
 void
@@ -525,8 +681,13 @@ tprintf(const char *fmt, ...)
 {
 	va_list args;
 
+	/* With --binary, decoders run only to fetch data */
+	if (capture_enabled)
+		return;
 	va_start(args, fmt);
-	if (current_tcp) {
+	if (current_tcp && assemble_lines)
+		linebuf_vprintf(current_tcp, fmt, args);
+	else if (current_tcp) {
 		int n = strace_vfprintf(current_tcp->outf, fmt, args);
 		if (n < 0) {
 			if (current_tcp->outf != stderr)
@@ -540,7 +701,15 @@ tprintf(const char *fmt, ...)
 void
 tprints(const char *str)
 {
-	if (current_tcp) {
+	if (capture_enabled)
+		return;
+	if (current_tcp && assemble_lines) {
+		unsigned int len = strlen(str);
+
+		linebuf_reserve(current_tcp, len);
+		memcpy(current_tcp->linebuf + current_tcp->curcol, str, len);
+		current_tcp->curcol += len;
+	} else if (current_tcp) {
 		int n = fputs_unlocked(str, current_tcp->outf);
 		if (n >= 0) {
 			current_tcp->curcol += strlen(str);
@@ -555,9 +724,14 @@ void
 line_ended(void)
 {
 	if (current_tcp) {
+		linebuf_flush(current_tcp);
 		current_tcp->curcol = 0;
-		fflush(current_tcp->outf);
+		if (!capture_enabled)
+			fflush(current_tcp->outf);
 	}
+	/* With assemble_lines, printing_tcp is not the only unfinished line */
+	if (printing_tcp && assemble_lines)
+		printing_tcp = NULL;
 	if (printing_tcp) {
 		printing_tcp->curcol = 0;
 		printing_tcp = NULL;
@@ -570,7 +744,7 @@ printleader(struct tcb *tcp)
 	/* If -ff, "previous tcb we printed" is always the same as current,
 	 * because we have per-tcb output files.
 	 */
-	if (followfork >= 2)
+	if (followfork >= 2 || assemble_lines)
 		printing_tcp = tcp;
 
 	if (printing_tcp) {
@@ -579,10 +753,12 @@ printleader(struct tcb *tcp)
 			/*
 			 * case 1: we have a shared log (i.e. not -ff), and last line
 			 * wasn't finished (same or different tcb, doesn't matter).
-			 * case 2: split log, we are the same tcb, but our last line
-			 * didn't finish ("SIGKILL nuked us after syscall entry" etc).
+			 * case 2: split log or assembled lines, we are the same tcb,
+			 * but our last line didn't finish ("SIGKILL nuked us after
+			 * syscall entry" etc).
 			 */
 			tprints(" <unfinished ...>\n");
+			linebuf_flush(printing_tcp);
 			printing_tcp->curcol = 0;
 		}
 	}
@@ -593,24 +769,24 @@ printleader(struct tcb *tcp)
 
 	if (print_pid_pfx)
 		tprintf("%-5d ", tcp->pid);
-	else if (nprocs > 1 && !outfname)
+	else if ((nprocs > 1 || ntracers > 1) && !outfname)
 		tprintf("[pid %5u] ", tcp->pid);
 
-	if (tflag) {
+	if (rflag) {
+		static uint64_t last;
+		uint64_t now = capture_monotonic_ns();
+		uint64_t delta = last ? now - last : 0;
+
+		tprintf("%6lu.%06lu ", (unsigned long) (delta / 1000000000),
+			(unsigned long) (delta % 1000000000 / 1000));
+		last = now;
+	}
+	else if (tflag) {
 		char str[sizeof("HH:MM:SS")];
-		struct timeval tv, dtv;
-		static struct timeval otv;
-
-		gettimeofday(&tv, NULL);
-		if (rflag) {
-			if (otv.tv_sec == 0)
-				otv = tv;
-			tv_sub(&dtv, &tv, &otv);
-			tprintf("%6ld.%06ld ",
-				(long) dtv.tv_sec, (long) dtv.tv_usec);
-			otv = tv;
-		}
-		else if (tflag > 2) {
+		struct timeval tv;
+
+		capture_gettime(&tv);
+		if (tflag > 2) {
 			tprintf("%ld.%06ld ",
 				(long) tv.tv_sec, (long) tv.tv_usec);
 		}
@@ -649,6 +825,60 @@ newoutf(struct tcb *tcp)
 	}
 }
 
+static void
+hash_tcb(struct tcb *tcp)
+{
+	struct tcb **head = &pidtab[pid_hash(tcp->pid)];
+
+	tcp->next = *head;
+	*head = tcp;
+}
+
+static void
+unhash_tcb(struct tcb *tcp)
+{
+	struct tcb **link = &pidtab[pid_hash(tcp->pid)];
+
+	while (*link != tcp)
+		link = &(*link)->next;
+	*link = tcp->next;
+	tcp->next = NULL;
+}
+
+/* Make pid hash table at least as big as tcbtab and rehash used tcbs */
+static void
+expand_pidtab(void)
+{
+	unsigned int i, size = 64;
+
+	while (size < tcbtabsize)
+		size *= 2;
+	if (pidtab && size == pidtab_mask + 1)
+		return;
+
+	free(pidtab);
+	pidtab = calloc(size, sizeof(pidtab[0]));
+	if (!pidtab)
+		die_out_of_memory();
+	pidtab_mask = size - 1;
+	for (i = 0; i < tcbtabsize; i++)
+		if (tcbtab[i]->pid)
+			hash_tcb(tcbtab[i]);
+}
+
+/* Put tcbtab[from..tcbtabsize-1] on the free list, lowest index first */
+static void
+free_tcbtab_tail(unsigned int from)
+{
+	unsigned int i = tcbtabsize;
+
+	while (i > from) {
+		struct tcb *tcp = tcbtab[--i];
+		tcp->next = free_tcbs;
+		free_tcbs = tcp;
+	}
+}
+
 static void
 expand_tcbtab(void)
 {
@@ -666,32 +896,46 @@ expand_tcbtab(void)
 	tcbtab = newtab;
 	while (i < tcbtabsize)
 		tcbtab[i++] = newtcbs++;
+	free_tcbtab_tail(tcbtabsize / 2);
+	expand_pidtab();
 }
 
 static struct tcb *
 alloctcb(int pid)
 {
-	int i;
 	struct tcb *tcp;
 
-	if (nprocs == tcbtabsize)
+	if (!free_tcbs)
 		expand_tcbtab();
 
-	for (i = 0; i < tcbtabsize; i++) {
-		tcp = tcbtab[i];
-		if (!tcp->pid) {
-			memset(tcp, 0, sizeof(*tcp));
-			tcp->pid = pid;
+	tcp = free_tcbs;
+	free_tcbs = tcp->next;
+	memset(tcp, 0, sizeof(*tcp));
+	tcp->pid = pid;
+	tcp->mem_fd = -1;
 #if SUPPORTED_PERSONALITIES > 1
-			tcp->currpers = current_personality;
+	tcp->currpers = current_personality;
 #endif
-			nprocs++;
-			if (debug_flag)
-				fprintf(stderr, "new tcb for pid %d, active tcbs:%d\n", tcp->pid, nprocs);
+	hash_tcb(tcp);
+	nprocs++;
+	if (debug_flag)
+		fprintf(stderr, "new tcb for pid %d, active tcbs:%d\n", tcp->pid, nprocs);
+	return tcp;
+}
+
+static struct tcb *
+pid2tcb(int pid)
+{
+	struct tcb *tcp;
+
+	if (pid <= 0)
+		return NULL;
+
+	for (tcp = pidtab[pid_hash(pid)]; tcp; tcp = tcp->next)
+		if (tcp->pid == pid)
 			return tcp;
-		}
-	}
-	error_msg_and_die("bug in alloctcb");
+
+	return NULL;
 }
 
 static void
@@ -708,20 +952,31 @@ droptcb(struct tcb *tcp)
 		if (followfork >= 2) {
 			if (tcp->curcol != 0)
 				fprintf(tcp->outf, " <detached ...>\n");
-			fclose(tcp->outf);
 		} else {
-			if (printing_tcp == tcp && tcp->curcol != 0)
+			if ((printing_tcp == tcp || assemble_lines) && tcp->curcol != 0) {
+				linebuf_flush(tcp);
 				fprintf(tcp->outf, " <detached ...>\n");
+			}
 			fflush(tcp->outf);
 		}
 	}
+	/* With -ff, it prints the summary of the process to its file */
+	count_release(tcp);
+	if (tcp->outf && followfork >= 2)
+		fclose(tcp->outf);
+	free(tcp->linebuf);
+	release_mem_fd(tcp);
+	fdcache_release(tcp);
 
 	if (current_tcp == tcp)
 		current_tcp = NULL;
 	if (printing_tcp == tcp)
 		printing_tcp = NULL;
 
+	unhash_tcb(tcp);
 	memset(tcp, 0, sizeof(*tcp));
+	tcp->next = free_tcbs;
+	free_tcbs = tcp;
 }
 
 /* Detach traced process.
@@ -921,6 +1176,155 @@ process_opt_p_list(char *opt)
 	}
 }
 
+/*
+ * Replace every -p PID with the list of its threads,
+ * so that threads of the same process can be traced by different tracers.
+ */
+static void
+expand_tasks(void)
+{
+	unsigned int tcbi, size = tcbtabsize;
+
+	for (tcbi = 0; tcbi < size; tcbi++) {
+		char procdir[sizeof("/proc/%d/task") + sizeof(int) * 3];
+		struct_dirent *de;
+		DIR *dir;
+		int pid = tcbtab[tcbi]->pid;
+
+		if (!pid || (tcbtab[tcbi]->flags & TCB_ATTACHED))
+			continue;
+		sprintf(procdir, "/proc/%d/task", pid);
+		dir = opendir(procdir);
+		if (dir == NULL)
+			continue;
+		while ((de = read_dir(dir)) != NULL) {
+			int tid;
+
+			if (de->d_fileno == 0)
+				continue;
+			tid = atoi(de->d_name);
+			if (tid <= 0 || tid == pid || pid2tcb(tid))
+				continue;
+			alloctcb(tid);
+		}
+		closedir(dir);
+	}
+}
+
+/*
+ * Fork ntracers - 1 additional tracers, and leave each of them
+ * (including ourself) with every ntracers'th tcb to attach to.
+ */
+static void
+startup_tracers(void)
+{
+	unsigned int tcbi, n, shard = 0;
+
+	if (followfork)
+		expand_tasks();
+
+	tracer_pids = calloc(ntracers - 1, sizeof(tracer_pids[0]));
+	if (!tracer_pids)
+		die_out_of_memory();
+	fflush(NULL);
+	for (n = 1; n < ntracers; n++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			perror_msg_and_die("fork");
+		if (pid == 0) {
+			shard = n;
+			strace_tracer_pid = getpid();
+			free(tracer_pids);
+			tracer_pids = NULL;
+			ntracer_pids = 0;
+			break;
+		}
+		tracer_pids[ntracer_pids++] = pid;
+	}
+
+	for (tcbi = 0, n = 0; tcbi < tcbtabsize; tcbi++) {
+		struct tcb *tcp = tcbtab[tcbi];
+
+		if (!tcp->pid)
+			continue;
+		if (n++ % ntracers != shard)
+			droptcb(tcp);
+	}
+}
+
+/* Are any of our additional tracers still running? */
+static bool
+live_tracers(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ntracer_pids; i++)
+		if (tracer_pids[i])
+			return 1;
+	return 0;
+}
+
+/* Is pid still traced by us?  Not if it is gone. */
+static bool
+traced_by_us(int pid)
+{
+	char path[sizeof("/proc/%u/status") + sizeof(int)*3];
+	char buf[2048];
+	const char *p;
+	ssize_t n;
+	int fd;
+
+	sprintf(path, "/proc/%u/status", pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return errno != ENOENT;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return 1;
+	buf[n] = '\0';
+	p = strstr(buf, "\nTracerPid:");
+	return !p || atoi(p + sizeof("\nTracerPid:") - 1) == strace_tracer_pid;
+}
+
+/*
+ * With --tracers, a thread group leader traced by another tracer than
+ * its execve'ing thread disappears without notification, leaving
+ * a stale tcb.  Once the other tracers are gone, no new stale tcbs can
+ * appear, and the processes of the stale ones are not traced by us.
+ */
+static void
+drop_stale_tcbs(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < tcbtabsize; i++) {
+		struct tcb *tcp = tcbtab[i];
+
+		if (tcp->pid && !traced_by_us(tcp->pid)) {
+			if (debug_flag)
+				fprintf(stderr, "dropping stale tcb for pid %d\n",
+					tcp->pid);
+			droptcb(tcp);
+		}
+	}
+}
+
+/* Is pid one of our additional tracers?  Forget it if it is. */
+static bool
+reap_tracer_pid(int pid)
+{
+	unsigned int i;
+
+	for (i = 0; i < ntracer_pids; i++)
+		if (tracer_pids[i] == pid) {
+			tracer_pids[i] = 0;
+			return 1;
+		}
+	return 0;
+}
+
 static void
 startup_attach(void)
 {
@@ -966,7 +1370,8 @@ startup_attach(void)
 		if (tcp->flags & TCB_ATTACHED)
 			continue; /* no, we already attached it */
 
-		if (followfork && !daemonized_tracer) {
+		/* With --tracers, the list of threads is already expanded */
+		if (followfork && !daemonized_tracer && ntracers == 1) {
 			char procdir[sizeof("/proc/%d/task") + sizeof(int) * 3];
 			DIR *dir;
 
@@ -1121,6 +1526,9 @@ exec_or_die(void)
 		alarm(0);
 	}
 
+	if (seccomp_filtering)
+		apply_seccomp_filter();
+
 	execv(params->pathname, params->argv);
 	perror_msg_and_die("exec");
 }
@@ -1604,8 +2012,43 @@ init(int argc, char *argv[])
 	struct tcb *tcp;
 	int c, i;
 	int optF = 0;
+	unsigned long output_buffer_size = 0;
+	const char *decode_file = NULL;
+	int output_overflow = OUTPUT_OVERFLOW_BLOCK;
 	struct sigaction sa;
 
+	enum {
+		SECCOMP_OPTION = 0x100,
+		TRACERS_OPTION,
+		OUTPUT_BUFFER_OPTION,
+		OUTPUT_OVERFLOW_OPTION,
+		UNFINISHED_OPTION,
+		BINARY_OPTION,
+		DECODE_OPTION,
+		FD_CACHE_OPTION,
+		DUMP_LIMIT_OPTION,
+		LATENCY_OPTION,
+		INTERVAL_OPTION,
+		SUMMARY_BY_OPTION,
+		SUMMARY_TOP_OPTION
+	};
+	static const struct option longopts[] = {
+		{ "seccomp-bpf",	no_argument,	0,	SECCOMP_OPTION },
+		{ "tracers",	required_argument,	0,	TRACERS_OPTION },
+		{ "output-buffer",	required_argument,	0,	OUTPUT_BUFFER_OPTION },
+		{ "output-overflow",	required_argument,	0,	OUTPUT_OVERFLOW_OPTION },
+		{ "unfinished",	no_argument,	0,	UNFINISHED_OPTION },
+		{ "binary",	no_argument,	0,	BINARY_OPTION },
+		{ "decode",	required_argument,	0,	DECODE_OPTION },
+		{ "fd-cache",	required_argument,	0,	FD_CACHE_OPTION },
+		{ "dump-limit",	required_argument,	0,	DUMP_LIMIT_OPTION },
+		{ "latency",	optional_argument,	0,	LATENCY_OPTION },
+		{ "interval",	required_argument,	0,	INTERVAL_OPTION },
+		{ "summary-by",	required_argument,	0,	SUMMARY_BY_OPTION },
+		{ "summary-top",	required_argument,	0,	SUMMARY_TOP_OPTION },
+		{ 0, 0, 0, 0 }
+	};
+
 	progname = argv[0] ? argv[0] : "strace";
 
 	/* Make sure SIGCHLD has the default action so that waitpid
@@ -1629,6 +2072,8 @@ init(int argc, char *argv[])
 		die_out_of_memory();
 	for (c = 0; c < tcbtabsize; c++)
 		tcbtab[c] = tcp++;
+	free_tcbtab_tail(0);
+	expand_pidtab();
 
 	shared_log = stderr;
 	set_sortby(DEFAULT_SORTBY);
@@ -1640,10 +2085,10 @@ init(int argc, char *argv[])
 # error Bug in DEFAULT_QUAL_FLAGS
 #endif
 	qualify("signal=all");
-	while ((c = getopt(argc, argv,
-		"+b:cCdfFhiqrtTvVxyz"
+	while ((c = getopt_long(argc, argv,
+		"+b:cCdfFhiqrtTvVwxyz"
 		"D"
-		"a:e:o:O:p:s:S:u:E:P:I:")) != EOF) {
+		"a:e:o:O:p:s:S:u:E:P:I:", longopts, NULL)) != EOF) {
 		switch (c) {
 		case 'b':
 			if (strcmp(optarg, "execve") != 0)
@@ -1693,6 +2138,9 @@ init(int argc, char *argv[])
 		case 'T':
 			Tflag = 1;
 			break;
+		case 'w':
+			count_wallclock = 1;
+			break;
 		case 'x':
 			xflag++;
 			break;
@@ -1753,6 +2201,82 @@ init(int argc, char *argv[])
 			if (opt_intr <= 0 || opt_intr >= NUM_INTR_OPTS)
 				error_opt_arg(c, optarg);
 			break;
+		case SECCOMP_OPTION:
+			seccomp_filtering = 1;
+			break;
+		case TRACERS_OPTION:
+			i = string_to_uint(optarg);
+			if (i <= 0)
+				error_msg_and_die("Invalid --tracers argument: '%s'", optarg);
+			ntracers = i;
+			break;
+		case OUTPUT_BUFFER_OPTION:
+			output_buffer_size = string_to_size(optarg);
+			if (!output_buffer_size)
+				error_msg_and_die("Invalid --output-buffer argument: '%s'", optarg);
+			break;
+		case OUTPUT_OVERFLOW_OPTION:
+			if (strcmp(optarg, "block") == 0)
+				output_overflow = OUTPUT_OVERFLOW_BLOCK;
+			else if (strcmp(optarg, "drop") == 0)
+				output_overflow = OUTPUT_OVERFLOW_DROP;
+			else if (strcmp(optarg, "count") == 0)
+				output_overflow = OUTPUT_OVERFLOW_COUNT;
+			else
+				error_msg_and_die("Invalid --output-overflow argument: '%s'", optarg);
+			break;
+		case UNFINISHED_OPTION:
+			print_unfinished = 1;
+			break;
+		case BINARY_OPTION:
+			capture_enabled = 1;
+			break;
+		case DECODE_OPTION:
+			decode_file = optarg;
+			break;
+		case FD_CACHE_OPTION:
+			if (strcmp(optarg, "on") == 0)
+				fdcache_mode = FDCACHE_ON;
+			else if (strcmp(optarg, "off") == 0)
+				fdcache_mode = FDCACHE_OFF;
+			else if (strcmp(optarg, "check") == 0)
+				fdcache_mode = FDCACHE_CHECK;
+			else
+				error_msg_and_die("Invalid --fd-cache argument: '%s'", optarg);
+			break;
+		case DUMP_LIMIT_OPTION:
+			dump_limit = string_to_size(optarg);
+			if (!dump_limit)
+				error_msg_and_die("Invalid --dump-limit argument: '%s'", optarg);
+			break;
+		case LATENCY_OPTION:
+			if (!optarg)
+				latency_mode = LATENCY_PERCENTILES;
+			else if (strcmp(optarg, "histogram") == 0)
+				latency_mode = LATENCY_HISTOGRAM;
+			else
+				error_msg_and_die("Invalid --latency argument: '%s'", optarg);
+			break;
+		case INTERVAL_OPTION:
+			i = string_to_uint(optarg);
+			if (i <= 0)
+				error_msg_and_die("Invalid --interval argument: '%s'", optarg);
+			summary_interval = i;
+			break;
+		case SUMMARY_BY_OPTION:
+			if (strcmp(optarg, "process") == 0)
+				summary_by = SUMMARY_BY_PROCESS;
+			else if (strcmp(optarg, "thread") == 0)
+				summary_by = SUMMARY_BY_THREAD;
+			else
+				error_msg_and_die("Invalid --summary-by argument: '%s'", optarg);
+			break;
+		case SUMMARY_TOP_OPTION:
+			i = string_to_uint(optarg);
+			if (i < 0)
+				error_msg_and_die("Invalid --summary-top argument: '%s'", optarg);
+			summary_top = i;
+			break;
 		default:
 			usage(stderr, 1);
 			break;
@@ -1767,21 +2291,77 @@ init(int argc, char *argv[])
 	memset(acolumn_spaces, ' ', acolumn);
 	acolumn_spaces[acolumn] = '\0';
 
+	if (decode_file) {
+		if (argv[0] || nprocs)
+			error_msg_and_die("--decode cannot be used with a command or -p");
+		if (capture_enabled)
+			error_msg_and_die("--binary and --decode are mutually exclusive");
+		if (cflag)
+			error_msg_and_die("(-c or -C) and --decode are mutually exclusive");
+		if (iflag)
+			error_msg_and_die("-i and --decode are mutually exclusive");
+		if (optF >= 2 || followfork >= 2)
+			error_msg_and_die("-ff and --decode are mutually exclusive");
+		/* Print pids if the capture has them */
+		if (capture_open(decode_file) & CAPTURE_F_MULTI)
+			followfork = 1;
+	}
 	/* Must have PROG [ARGS], or -p PID. Not both. */
-	if (!argv[0] == !nprocs)
+	else if (!argv[0] == !nprocs)
 		usage(stderr, 1);
 
+	if (capture_enabled) {
+		if (!outfname)
+			error_msg_and_die("--binary requires -o");
+		if (cflag)
+			error_msg_and_die("(-c or -C) and --binary are mutually exclusive");
+		if (ntracers > 1)
+			error_msg_and_die("--tracers and --binary are mutually exclusive");
+		if (optF >= 2 || followfork >= 2)
+			error_msg_and_die("-ff and --binary are mutually exclusive");
+	}
+
 	if (nprocs != 0 && daemonized_tracer) {
 		error_msg_and_die("-D and -p are mutually exclusive");
 	}
 
+	if (ntracers > 1) {
+		if (argv[0])
+			error_msg_and_die("--tracers can only be used with -p");
+		if (cflag)
+			error_msg_and_die("(-c or -C) and --tracers are mutually exclusive");
+	}
+
 	if (!followfork)
 		followfork = optF;
 
-	if (followfork >= 2 && cflag) {
-		error_msg_and_die("(-c or -C) and -ff are mutually exclusive");
+	if (seccomp_filtering) {
+		/*
+		 * Untraced children would get ENOSYS for every syscall
+		 * the filter returns SECCOMP_RET_TRACE for.
+		 */
+		if (detach_on_execve)
+			error_msg_and_die("--seccomp-bpf and -b execve are mutually exclusive");
+		if (nprocs != 0 || daemonized_tracer) {
+			error_msg("--seccomp-bpf cannot be used with -p or -D, disabled");
+			seccomp_filtering = 0;
+		} else if (!followfork)
+			followfork = 1;
 	}
 
+	/* -c -ff: the summary of every process goes to its own file */
+	if (followfork >= 2 && cflag && !summary_by)
+		summary_by = SUMMARY_BY_PROCESS;
+
+	if (latency_mode && !cflag)
+		error_msg_and_die("--latency requires -c or -C");
+	if (count_wallclock && !cflag)
+		error_msg_and_die("-w requires -c or -C");
+	if (summary_interval && !cflag)
+		error_msg_and_die("--interval requires -c or -C");
+	if (summary_by && !cflag)
+		error_msg_and_die("--summary-by requires -c or -C");
+
 	/* See if they want to run as another user. */
 	if (username != NULL) {
 		struct passwd *pent;
@@ -1806,10 +2386,41 @@ init(int argc, char *argv[])
 	 * need_fork_exec_workarounds should stay 0 after these tests:
 	 */
 	/*need_fork_exec_workarounds = 0; - already is */
-	if (followfork)
-		need_fork_exec_workarounds = test_ptrace_setoptions_followfork();
-	need_fork_exec_workarounds |= test_ptrace_setoptions_for_all();
-	test_ptrace_seize();
+	if (!capture_decoding) {
+		if (followfork)
+			need_fork_exec_workarounds = test_ptrace_setoptions_followfork();
+		need_fork_exec_workarounds |= test_ptrace_setoptions_for_all();
+		test_ptrace_seize();
+		/* PTRACE_GET_SYSCALL_INFO needs PTRACE_O_TRACESYSGOOD */
+		if (syscall_trap_sig == (SIGTRAP | 0x80))
+			init_syscall_info();
+	}
+
+	/*
+	 * With --tracers, threads of a process may be traced by
+	 * different tracers, and none of them sees all changes
+	 * of the descriptor table.
+	 */
+	fdcache_enabled = fdcache_mode != FDCACHE_OFF
+			  && (show_fd_path || tracing_paths)
+			  && !capture_decoding && ntracers == 1;
+
+	if (seccomp_filtering) {
+		if (need_fork_exec_workarounds) {
+			error_msg("--seccomp-bpf is not supported without "
+				  "PTRACE_O_TRACECLONE, disabled");
+			seccomp_filtering = 0;
+		} else
+			init_seccomp_filter();
+		if (seccomp_filtering)
+			ptrace_setoptions |= PTRACE_O_TRACESECCOMP;
+	}
+
+	if (output_buffer_size) {
+		if (!outfname)
+			error_msg_and_die("--output-buffer requires -o");
+		async_output_init(output_buffer_size, output_overflow);
+	}
 
 	/* Check if they want to redirect the output. */
 	if (outfname) {
@@ -1831,7 +2442,12 @@ init(int argc, char *argv[])
 			followfork = 1;
 	}
 
-	if (!outfname || outfname[0] == '|' || outfname[0] == '!') {
+	/*
+	 * Several tracers writing to the same log must not split lines,
+	 * so use line buffering for it, too.
+	 */
+	if ((!outfname || outfname[0] == '|' || outfname[0] == '!'
+	     || (ntracers > 1 && followfork < 2)) && !capture_enabled) {
 		char *buf = malloc(BUFSIZ);
 		if (!buf)
 			die_out_of_memory();
@@ -1896,6 +2512,8 @@ init(int argc, char *argv[])
 		sigaction(SIGPIPE, &sa, NULL);
 		sigaction(SIGTERM, &sa, NULL);
 	}
+	if (ntracers > 1)
+		startup_tracers();
 	if (nprocs != 0 || daemonized_tracer)
 		startup_attach();
 
@@ -1904,24 +2522,24 @@ init(int argc, char *argv[])
 	 * -f: yes (there can be more pids in the future); or
 	 * -p PID1,PID2: yes (there are already more than one pid)
 	 */
-	print_pid_pfx = (outfname && followfork < 2 && (followfork == 1 || nprocs > 1));
-}
-
-static struct tcb *
-pid2tcb(int pid)
-{
-	int i;
-
-	if (pid <= 0)
-		return NULL;
-
-	for (i = 0; i < tcbtabsize; i++) {
-		struct tcb *tcp = tcbtab[i];
-		if (tcp->pid == pid)
-			return tcp;
-	}
+	print_pid_pfx = (outfname && followfork < 2 && (followfork == 1 || nprocs > 1 || ntracers > 1));
+	/*
+	 * Several tcbs write to the same log: keep every syscall
+	 * on one line instead of splitting it when another tcb
+	 * prints something between its entry and exit.
+	 */
+	assemble_lines = (!print_unfinished && followfork < 2
+			  && (followfork == 1 || nprocs > 1 || ntracers > 1));
+	if (capture_enabled)
+		capture_start(shared_log, followfork == 1 || nprocs > 1
+					  ? CAPTURE_F_MULTI : 0);
 
-	return NULL;
+	/*
+	 * The writer thread is started only now, when there will be
+	 * no more forks of the tracer, and the tracee does not need
+	 * our stdio any more.
+	 */
+	async_output_start();
 }
 
 static void
@@ -1949,8 +2567,21 @@ cleanup(void)
 		}
 		detach(tcp);
 	}
+	/* Other tracers detach from their tracees on their own */
+	for (i = 0; i < ntracer_pids; i++) {
+		if (!tracer_pids[i])
+			continue;
+		kill(tracer_pids[i], fatal_sig);
+		while (waitpid(tracer_pids[i], NULL, 0) < 0 && errno == EINTR)
+			;
+	}
 	if (cflag)
 		call_summary(shared_log);
+	if (debug_flag) {
+		umove_cache_stats();
+		fdcache_stats();
+		arena_stats();
+	}
 }
 
 static void
@@ -1959,10 +2590,184 @@ interrupt(int sig)
 	interrupted = sig;
 }
 
+static void
+print_killed(struct tcb *tcp, int status)
+{
+	if (cflag == CFLAG_ONLY_STATS
+	 || !(qual_flags[WTERMSIG(status)] & QUAL_SIGNAL))
+		return;
+	if (capture_enabled)
+		capture_event(tcp, CAPTURE_KILLED, status);
+	printleader(tcp);
+#ifdef WCOREDUMP
+	tprintf("+++ killed by %s %s+++\n",
+		signame(WTERMSIG(status)),
+		WCOREDUMP(status) ? "(core dumped) " : "");
+#else
+	tprintf("+++ killed by %s +++\n",
+		signame(WTERMSIG(status)));
+#endif
+	line_ended();
+}
+
+static void
+print_exited(struct tcb *tcp, int status)
+{
+	if (cflag == CFLAG_ONLY_STATS || qflag >= 2)
+		return;
+	if (capture_enabled)
+		capture_event(tcp, CAPTURE_EXITED, status);
+	printleader(tcp);
+	tprintf("+++ exited with %d +++\n", WEXITSTATUS(status));
+	line_ended();
+}
+
+/* si is NULL if tracee is stopped by signal */
+static void
+print_stopsig(struct tcb *tcp, int sig, siginfo_t *si)
+{
+	if (cflag == CFLAG_ONLY_STATS
+	 || hide_log_until_execve
+	 || !(qual_flags[sig] & QUAL_SIGNAL))
+		return;
+	if (capture_enabled) {
+		capture_begin(tcp, CAPTURE_SIGNAL, sig);
+		if (si)
+			capture_put_siginfo(si);
+		capture_end(tcp);
+	}
+	printleader(tcp);
+	if (si) {
+		tprintf("--- %s ", signame(sig));
+		printsiginfo(si, verbose(tcp));
+		tprints(" ---\n");
+	} else
+		tprintf("--- stopped by %s ---\n",
+			signame(sig));
+	line_ended();
+}
+
+/*
+ * Execve in a non-leader thread changed its pid to the leader's pid:
+ * drop leader's tcb and let execve thread's tcb replace it.
+ */
+static struct tcb *
+switch_execve_tcbs(struct tcb *tcp, struct tcb *execve_thread)
+{
+	int pid = tcp->pid;
+	long old_pid = execve_thread->pid;
+	FILE *fp;
+
+	if (execve_thread->curcol != 0) {
+		/*
+		 * One case we are here is -ff:
+		 * try "strace -oLOG -ff test/threaded_execve"
+		 */
+		linebuf_flush(execve_thread);
+		fprintf(execve_thread->outf, " <pid changed to %d ...>\n", pid);
+		/*execve_thread->curcol = 0; - no need, see code below */
+	}
+	if (assemble_lines && tcp->curcol != 0) {
+		/* The leader's line is never going to be finished */
+		linebuf_flush(tcp);
+		fprintf(tcp->outf, " <unfinished ...>\n");
+		tcp->curcol = 0;
+	}
+	/* Swap output FILEs (needed for -ff) */
+	fp = execve_thread->outf;
+	execve_thread->outf = tcp->outf;
+	tcp->outf = fp;
+	/* And their column positions */
+	execve_thread->curcol = tcp->curcol;
+	tcp->curcol = 0;
+	/* Drop leader, but close execve'd thread outfile (if -ff) */
+	droptcb(tcp);
+	/* Switch to the thread, reusing leader's outfile and pid */
+	tcp = execve_thread;
+	unhash_tcb(tcp);
+	tcp->pid = pid;
+	hash_tcb(tcp);
+	if (cflag != CFLAG_ONLY_STATS) {
+		if (capture_enabled)
+			capture_event(tcp, CAPTURE_EXECVE, old_pid);
+		printleader(tcp);
+		tprintf("+++ superseded by execve in pid %lu +++\n", old_pid);
+		line_ended();
+		tcp->flags |= TCB_REPRINT;
+	}
+	return tcp;
+}
+
+/*
+ * --decode: print a capture made with --binary, as if the events
+ * in it were seen by trace().
+ */
+static void
+decode_capture(void)
+{
+	unsigned int type, i;
+	int pid;
+	long arg;
+
+	while ((type = capture_next(&pid, &arg)) != 0) {
+		struct tcb *tcp, *execve_thread;
+		siginfo_t si;
+
+		if (interrupted)
+			break;
+		arena_reset();
+		tcp = pid2tcb(pid);
+		if (!tcp) {
+			tcp = alloctcb(pid);
+			newoutf(tcp);
+		}
+		current_tcp = tcp;
+
+		switch (type) {
+		case CAPTURE_ENTRY:
+			/* The previous syscall never returned */
+			tcp->flags &= ~TCB_INSYSCALL;
+			capture_get_syscall(tcp);
+			trace_syscall(tcp);
+			break;
+		case CAPTURE_EXIT:
+			/* Skip exits of syscalls whose entry was not captured */
+			if (exiting(tcp)) {
+				capture_get_syscall(tcp);
+				trace_syscall(tcp);
+			}
+			break;
+		case CAPTURE_SIGNAL:
+			print_stopsig(tcp, arg,
+				      capture_get_siginfo(&si) < 0 ? NULL : &si);
+			break;
+		case CAPTURE_EXITED:
+			print_exited(tcp, arg);
+			droptcb(tcp);
+			break;
+		case CAPTURE_KILLED:
+			print_killed(tcp, arg);
+			droptcb(tcp);
+			break;
+		case CAPTURE_EXECVE:
+			execve_thread = pid2tcb(arg);
+			if (execve_thread && execve_thread != tcp)
+				switch_execve_tcbs(tcp, execve_thread);
+			break;
+		}
+	}
+
+	/* Processes which were still traced when the capture ended */
+	for (i = 0; i < tcbtabsize; i++)
+		if (tcbtab[i]->pid)
+			droptcb(tcbtab[i]);
+}
+
 static void
 trace(void)
 {
 	struct rusage ru;
+	bool stale_dropped = 0;
 
 	/* Used to be "while (nprocs != 0)", but in this testcase:
 	 *  int main() { _exit(!!fork()); }
@@ -1983,13 +2788,28 @@ trace(void)
 		int wait_errno;
 		int status, sig;
 		int stopped;
+		int restart_op;
 		struct tcb *tcp;
 		unsigned event;
 
 		if (interrupted)
 			return;
 
-		if (popen_pid != 0 && nprocs == 0)
+		/*
+		 * The logger never exits on its own, so stop waiting when
+		 * there are no tracees, but not before the other tracers,
+		 * which are still tracing theirs, exit and are reaped.
+		 * Being our child, the logger also keeps wait4 from failing
+		 * with ECHILD, which is the way out of stale tcbs otherwise.
+		 */
+		if (popen_pid != 0 && ntracers > 1 && !stale_dropped
+		    && !live_tracers()) {
+			drop_stale_tcbs();
+			stale_dropped = 1;
+		}
+		if (popen_pid != 0 && nprocs == 0 && !live_tracers())
+			return;
+		if (interval_pid != 0 && nprocs == 0)
 			return;
 
 		if (interactive)
@@ -2002,7 +2822,13 @@ trace(void)
 		if (pid < 0) {
 			if (wait_errno == EINTR)
 				continue;
-			if (nprocs == 0 && wait_errno == ECHILD)
+			/*
+			 * With --tracers, a thread group leader traced by
+			 * another tracer than its execve'ing thread
+			 * disappears without notification, so there can be
+			 * a stale tcb left when we have no children.
+			 */
+			if ((nprocs == 0 || ntracers > 1) && wait_errno == ECHILD)
 				return;
 			/* If nprocs > 0, ECHILD is not expected,
 			 * treat it as any other error here:
@@ -2017,6 +2843,33 @@ trace(void)
 			continue;
 		}
 
+		if (pid == interval_pid) {
+			uint64_t now = monotonic_ns();
+
+			/*
+			 * With -C, the table goes to the shared log: don't
+			 * write it into the middle of a syscall's line.
+			 * The exit will be printed as "<... resumed>".
+			 */
+			if (printing_tcp && printing_tcp->curcol != 0
+			    && followfork < 2 && !assemble_lines
+			    && have_counts()) {
+				fprintf(printing_tcp->outf, " <unfinished ...>\n");
+				printing_tcp->curcol = 0;
+				printing_tcp = NULL;
+			}
+			interval_summary(shared_log, now - interval_last);
+			interval_last = now;
+			start_interval_child();
+			continue;
+		}
+
+		if (ntracer_pids && reap_tracer_pid(pid)) {
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				exit_code = 1;
+			continue;
+		}
+
 		event = ((unsigned)status >> 16);
 		if (debug_flag) {
 			char buf[sizeof("WIFEXITED,exitcode=%u") + sizeof(int)*3 /*paranoia:*/ + 16];
@@ -2049,6 +2902,7 @@ trace(void)
 					[PTRACE_EVENT_VFORK_DONE] = "VFORK_DONE",
 					[PTRACE_EVENT_EXEC]  = "EXEC",
 					[PTRACE_EVENT_EXIT]  = "EXIT",
+					[PTRACE_EVENT_SECCOMP] = "SECCOMP",
 					/* [PTRACE_EVENT_STOP (=128)] would make biggish array */
 				};
 				const char *e = "??";
@@ -2092,7 +2946,17 @@ trace(void)
 		}
 
 		clear_regs();
-		if (WIFSTOPPED(status))
+		/* A new stop, possibly of a new process with a reused pid */
+		umove_cache_invalidate();
+		arena_reset();
+		/*
+		 * At syscall stops, PTRACE_GET_SYSCALL_INFO is used instead,
+		 * and registers are fetched only when something needs them.
+		 */
+		if (WIFSTOPPED(status)
+		 && !(use_syscall_info
+		      && (WSTOPSIG(status) == syscall_trap_sig
+			  || event == PTRACE_EVENT_SECCOMP)))
 			get_regs(pid);
 
 		/* Under Linux, execve changes pid to thread leader's pid,
@@ -2110,7 +2974,6 @@ trace(void)
 		 * On 2.6 and earlier, it can return garbage.
 		 */
 		if (event == PTRACE_EVENT_EXEC && os_release >= KERNEL_VERSION(3,0,0)) {
-			FILE *fp;
 			struct tcb *execve_thread;
 			long old_pid = 0;
 
@@ -2126,36 +2989,13 @@ trace(void)
 			if (!execve_thread)
 				goto dont_switch_tcbs;
 
-			if (execve_thread->curcol != 0) {
-				/*
-				 * One case we are here is -ff:
-				 * try "strace -oLOG -ff test/threaded_execve"
-				 */
-				fprintf(execve_thread->outf, " <pid changed to %d ...>\n", pid);
-				/*execve_thread->curcol = 0; - no need, see code below */
-			}
-			/* Swap output FILEs (needed for -ff) */
-			fp = execve_thread->outf;
-			execve_thread->outf = tcp->outf;
-			tcp->outf = fp;
-			/* And their column positions */
-			execve_thread->curcol = tcp->curcol;
-			tcp->curcol = 0;
-			/* Drop leader, but close execve'd thread outfile (if -ff) */
-			droptcb(tcp);
-			/* Switch to the thread, reusing leader's outfile and pid */
-			tcp = execve_thread;
-			tcp->pid = pid;
-			if (cflag != CFLAG_ONLY_STATS) {
-				printleader(tcp);
-				tprintf("+++ superseded by execve in pid %lu +++\n", old_pid);
-				line_ended();
-				tcp->flags |= TCB_REPRINT;
-			}
+			tcp = switch_execve_tcbs(tcp, execve_thread);
 		}
  dont_switch_tcbs:
 
 		if (event == PTRACE_EVENT_EXEC) {
+			/* The old /proc/PID/mem refers to the old program */
+			release_mem_fd(tcp);
 			if (detach_on_execve && !skip_one_b_execve)
 				detach(tcp); /* do "-b execve" thingy */
 			skip_one_b_execve = 0;
@@ -2165,39 +3005,23 @@ trace(void)
 		current_tcp = tcp;
 
 		if (cflag) {
-			tv_sub(&tcp->dtime, &ru.ru_stime, &tcp->stime);
-			tcp->stime = ru.ru_stime;
+			uint64_t stime = timeval_ns(&ru.ru_stime);
+
+			tcp->dtime = stime - tcp->stime;
+			tcp->stime = stime;
 		}
 
 		if (WIFSIGNALED(status)) {
 			if (pid == strace_child)
 				exit_code = 0x100 | WTERMSIG(status);
-			if (cflag != CFLAG_ONLY_STATS
-			 && (qual_flags[WTERMSIG(status)] & QUAL_SIGNAL)
-			) {
-				printleader(tcp);
-#ifdef WCOREDUMP
-				tprintf("+++ killed by %s %s+++\n",
-					signame(WTERMSIG(status)),
-					WCOREDUMP(status) ? "(core dumped) " : "");
-#else
-				tprintf("+++ killed by %s +++\n",
-					signame(WTERMSIG(status)));
-#endif
-				line_ended();
-			}
+			print_killed(tcp, status);
 			droptcb(tcp);
 			continue;
 		}
 		if (WIFEXITED(status)) {
 			if (pid == strace_child)
 				exit_code = WEXITSTATUS(status);
-			if (cflag != CFLAG_ONLY_STATS &&
-			    qflag < 2) {
-				printleader(tcp);
-				tprintf("+++ exited with %d +++\n", WEXITSTATUS(status));
-				line_ended();
-			}
+			print_exited(tcp, status);
 			droptcb(tcp);
 			continue;
 		}
@@ -2238,6 +3062,23 @@ trace(void)
 
 		sig = WSTOPSIG(status);
 
+		if (event == PTRACE_EVENT_SECCOMP) {
+			/*
+			 * Before Linux 4.8, seccomp stop happens before
+			 * syscall-enter-stop: resume with PTRACE_SYSCALL
+			 * and handle the syscall entry as usual.
+			 * Since 4.8, seccomp filters run after the point
+			 * where syscall-enter-stop would have been reported,
+			 * so treat seccomp stop as syscall entry.
+			 */
+			if (os_release < KERNEL_VERSION(4,8,0)) {
+				sig = 0;
+				restart_op = PTRACE_SYSCALL;
+				goto restart_tracee_op;
+			}
+			goto trace_syscall_stop;
+		}
+
 		if (event != 0) {
 			/* Ptrace event */
 #if USE_SEIZE
@@ -2284,20 +3125,7 @@ trace(void)
 #if USE_SEIZE
  show_stopsig:
 #endif
-			if (cflag != CFLAG_ONLY_STATS
-			    && !hide_log_until_execve
-			    && (qual_flags[sig] & QUAL_SIGNAL)
-			   ) {
-				printleader(tcp);
-				if (!stopped) {
-					tprintf("--- %s ", signame(sig));
-					printsiginfo(&si, verbose(tcp));
-					tprints(" ---\n");
-				} else
-					tprintf("--- stopped by %s ---\n",
-						signame(sig));
-				line_ended();
-			}
+			print_stopsig(tcp, sig, stopped ? NULL : &si);
 
 			if (!stopped)
 				/* It's signal-delivery-stop. Inject the signal */
@@ -2329,6 +3157,7 @@ trace(void)
 		 * (Or it still can be that pesky post-execve SIGTRAP!)
 		 * Handle it.
 		 */
+ trace_syscall_stop:
 		if (trace_syscall(tcp) < 0) {
 			/* ptrace() failed in trace_syscall().
 			 * Likely a result of process disappearing mid-flight.
@@ -2345,7 +3174,16 @@ trace(void)
  restart_tracee_with_sig_0:
 		sig = 0;
  restart_tracee:
-		if (ptrace_restart(PTRACE_SYSCALL, tcp, sig) < 0) {
+		/*
+		 * With --seccomp-bpf, the tracee runs freely until
+		 * the next traced syscall unless it is inside one.
+		 */
+		if (seccomp_filtering && !(tcp->flags & TCB_INSYSCALL))
+			restart_op = PTRACE_CONT;
+		else
+			restart_op = PTRACE_SYSCALL;
+ restart_tracee_op:
+		if (ptrace_restart(restart_op, tcp, sig) < 0) {
 			/* Note: ptrace_restart emitted error message */
 			exit_code = 1;
 			return;
@@ -2358,13 +3196,21 @@ main(int argc, char *argv[])
 {
 	init(argc, argv);
 
-	/* Run main tracing loop */
-	trace();
+	if (capture_decoding)
+		decode_capture();
+	else {
+		if (summary_interval)
+			start_interval_child();
+		/* Run main tracing loop */
+		trace();
+		stop_interval_child();
+	}
 
 	cleanup();
 	fflush(NULL);
 	if (shared_log != stderr)
 		fclose(shared_log);
+	async_output_finish();
 	if (popen_pid) {
 		while (waitpid(popen_pid, NULL, 0) < 0 && errno == EINTR)
 			;
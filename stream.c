@@ -270,6 +270,9 @@ static int
 decode_poll(struct tcb *tcp, long pts)
 {
 	struct pollfd fds;
+	/* pollfds are fetched in batches */
+	struct pollfd fdbuf[32];
+	unsigned int nbuf = 0, ibuf = 0;
 	unsigned nfds;
 	unsigned long size, start, cur, end, abbrev_end;
 	int failed = 0;
@@ -299,11 +302,19 @@ decode_poll(struct tcb *tcp, long pts)
 				tprints("...");
 				break;
 			}
-			if (umoven(tcp, cur, sizeof fds, (char *) &fds) < 0) {
+			if (ibuf == nbuf) {
+				ibuf = 0;
+				nbuf = umove_array(tcp, cur, sizeof(fds),
+					MIN(ARRAY_SIZE(fdbuf),
+					    (MIN(end, abbrev_end) - cur) / sizeof(fds)),
+					fdbuf);
+			}
+			if (ibuf == nbuf) {
 				tprints("?");
 				failed = 1;
 				break;
 			}
+			fds = fdbuf[ibuf++];
 			if (fds.fd < 0) {
 				tprintf("{fd=%d}", fds.fd);
 				continue;
@@ -349,12 +360,20 @@ decode_poll(struct tcb *tcp, long pts)
 		outptr = outstr;
 
 		for (cur = start; cur < end; cur += sizeof(fds)) {
-			if (umoven(tcp, cur, sizeof fds, (char *) &fds) < 0) {
+			if (ibuf == nbuf) {
+				ibuf = 0;
+				nbuf = umove_array(tcp, cur, sizeof(fds),
+					MIN(ARRAY_SIZE(fdbuf),
+					    (end - cur) / sizeof(fds)),
+					fdbuf);
+			}
+			if (ibuf == nbuf) {
 				if (outptr < end_outstr - 2)
 					*outptr++ = '?';
 				failed = 1;
 				break;
 			}
+			fds = fdbuf[ibuf++];
 			if (!fds.revents)
 				continue;
 			if (outptr == outstr) {
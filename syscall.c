@@ -72,6 +72,10 @@
 #ifdef HAVE_ELF_H
 # include <elf.h>
 #endif
+/* for AUDIT_ARCH_* */
+#ifdef HAVE_LINUX_AUDIT_H
+# include <linux/audit.h>
+#endif
 
 #if defined(AARCH64)
 # include <asm/ptrace.h>
@@ -1120,6 +1124,25 @@ get_regs(pid_t pid)
 }
 #endif /* !get_regs */
 
+/* Set s_ent and qual_flg according to tcp->scno */
+static void
+set_sysent(struct tcb *tcp)
+{
+	if (SCNO_IS_VALID(tcp->scno)) {
+		tcp->s_ent = &sysent[tcp->scno];
+		tcp->qual_flg = qual_flags[tcp->scno];
+	} else {
+		static const struct_sysent unknown = {
+			.nargs = MAX_ARGS,
+			.sys_flags = 0,
+			.sys_func = printargs,
+			.sys_name = "unknown", /* not used */
+		};
+		tcp->s_ent = &unknown;
+		tcp->qual_flg = UNDEFINED_SCNO | QUAL_RAW | DEFAULT_QUAL_FLAGS;
+	}
+}
+
 /* Returns:
  * 0: "ignore this ptrace stop", bail out of trace_syscall_entering() silently.
  * 1: ok, continue in trace_syscall_entering().
@@ -1554,19 +1577,7 @@ get_scno(struct tcb *tcp)
 #endif
 
 	tcp->scno = scno;
-	if (SCNO_IS_VALID(tcp->scno)) {
-		tcp->s_ent = &sysent[scno];
-		tcp->qual_flg = qual_flags[scno];
-	} else {
-		static const struct_sysent unknown = {
-			.nargs = MAX_ARGS,
-			.sys_flags = 0,
-			.sys_func = printargs,
-			.sys_name = "unknown", /* not used */
-		};
-		tcp->s_ent = &unknown;
-		tcp->qual_flg = UNDEFINED_SCNO | QUAL_RAW | DEFAULT_QUAL_FLAGS;
-	}
+	set_sysent(tcp);
 	return 1;
 }
 
@@ -1954,6 +1965,252 @@ get_syscall_args(struct tcb *tcp)
 	return 1;
 }
 
+/*
+ * PTRACE_GET_SYSCALL_INFO backend.
+ *
+ * Since Linux 5.3, a single PTRACE_GET_SYSCALL_INFO request returns
+ * the syscall number, arguments and audit arch at syscall entry,
+ * and the return value at syscall exit.  Where it is available,
+ * syscall stops are served by it alone: registers are not fetched
+ * unless something needs them (-i, sigreturn decoders), and none of
+ * the per-arch get_scno/get_syscall_args/get_syscall_result code runs.
+ * Whenever the request fails or returns something unexpected,
+ * we fall back to get_regs() and the per-arch code.
+ */
+#if defined(HAVE_LINUX_AUDIT_H) \
+ && (defined(I386) || defined(X86_64) || defined(X32) \
+  || defined(ARM) || defined(AARCH64) \
+  || defined(POWERPC) \
+  || defined(S390) || defined(S390X))
+# define USE_SYSCALL_INFO 1
+#endif
+
+bool use_syscall_info = 0;
+
+#ifdef USE_SYSCALL_INFO
+
+# ifndef PTRACE_SYSCALL_INFO_ENTRY
+#  define PTRACE_SYSCALL_INFO_NONE	0
+#  define PTRACE_SYSCALL_INFO_ENTRY	1
+#  define PTRACE_SYSCALL_INFO_EXIT	2
+#  define PTRACE_SYSCALL_INFO_SECCOMP	3
+# endif
+
+/* Same layout as struct ptrace_syscall_info in <linux/ptrace.h> */
+struct syscall_info {
+	uint8_t op;
+	uint8_t pad[3];
+	uint32_t arch;
+	uint64_t instruction_pointer;
+	uint64_t stack_pointer;
+	union {
+		struct {
+			uint64_t nr;
+			uint64_t args[6];
+		} entry;
+		struct {
+			int64_t rval;
+			uint8_t is_error;
+		} exit;
+		struct {
+			uint64_t nr;
+			uint64_t args[6];
+			uint32_t ret_data;
+		} seccomp;
+	} u;
+};
+
+void
+init_syscall_info(void)
+{
+	use_syscall_info = (os_release >= KERNEL_VERSION(5,3,0));
+	if (debug_flag)
+		fprintf(stderr, "PTRACE_GET_SYSCALL_INFO %s\n",
+			use_syscall_info ? "will be used" : "is not available");
+}
+
+/*
+ * Returns 1 if PTRACE_GET_SYSCALL_INFO reported a stop of the type op,
+ * 0 otherwise.  In the latter case registers are fetched, so that
+ * the caller can fall back to the per-arch code.
+ */
+static int
+get_syscall_info(struct tcb *tcp, struct syscall_info *info, uint8_t op)
+{
+	if (ptrace(PTRACE_GET_SYSCALL_INFO, tcp->pid,
+		   (char *) sizeof(*info), (long) info) < 0) {
+		if (errno == EIO) {
+			/* The kernel does not know this request */
+			use_syscall_info = 0;
+			if (debug_flag)
+				fprintf(stderr, "PTRACE_GET_SYSCALL_INFO "
+					"is not supported, falling back "
+					"to registers\n");
+		}
+		get_regs(tcp->pid);
+		return 0;
+	}
+	if (info->op != op
+	 && !(op == PTRACE_SYSCALL_INFO_ENTRY
+	      && info->op == PTRACE_SYSCALL_INFO_SECCOMP)) {
+		if (debug_flag)
+			fprintf(stderr, "pid %d: unexpected "
+				"PTRACE_GET_SYSCALL_INFO op %u\n",
+				tcp->pid, info->op);
+		get_regs(tcp->pid);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Derive personality from audit arch, strip personality bits from *scno.
+ * Returns -1 if the audit arch is not one we expect.
+ */
+static int
+syscall_info_personality(uint32_t arch, unsigned long *scno)
+{
+# if defined(X86_64)
+	switch (arch) {
+	case AUDIT_ARCH_X86_64:
+		if (*scno & __X32_SYSCALL_BIT) {
+			*scno -= __X32_SYSCALL_BIT;
+			return 2;
+		}
+		return 0;
+	case AUDIT_ARCH_I386:
+		return 1;
+	}
+# elif defined(X32)
+	switch (arch) {
+	case AUDIT_ARCH_X86_64:
+		/* 64-bit mode is not supported, let get_scno() complain */
+		if (*scno & __X32_SYSCALL_BIT) {
+			*scno -= __X32_SYSCALL_BIT;
+			return 0;
+		}
+		break;
+	case AUDIT_ARCH_I386:
+		return 1;
+	}
+# elif defined(AARCH64)
+	switch (arch) {
+	case AUDIT_ARCH_AARCH64:
+		return 1;
+	case AUDIT_ARCH_ARM:
+		return 0;
+	}
+# elif defined(POWERPC64)
+	switch (arch) {
+#  ifdef AUDIT_ARCH_PPC64LE
+	case AUDIT_ARCH_PPC64LE:
+#  endif
+	case AUDIT_ARCH_PPC64:
+		return 0;
+	case AUDIT_ARCH_PPC:
+		return 1;
+	}
+# elif defined(ARM)
+	if (arch == AUDIT_ARCH_ARM) {
+		*scno = shuffle_scno(*scno);
+		return 0;
+	}
+# elif defined(I386)
+	if (arch == AUDIT_ARCH_I386)
+		return 0;
+# elif defined(POWERPC)
+	if (arch == AUDIT_ARCH_PPC)
+		return 0;
+# elif defined(S390X)
+	if (arch == AUDIT_ARCH_S390X)
+		return 0;
+# elif defined(S390)
+	if (arch == AUDIT_ARCH_S390)
+		return 0;
+# endif
+	return -1;
+}
+
+/* Syscall entry counterpart of get_scno() and get_syscall_args() */
+static int
+syscall_info_entering(struct tcb *tcp)
+{
+	struct syscall_info info;
+	unsigned long scno;
+	int i, pers;
+
+	if (!get_syscall_info(tcp, &info, PTRACE_SYSCALL_INFO_ENTRY))
+		return 0;
+	/* entry.nr and entry.args share their offsets with seccomp.* */
+	scno = info.u.entry.nr;
+	pers = syscall_info_personality(info.arch, &scno);
+	if (pers < 0) {
+		get_regs(tcp->pid);
+		return 0;
+	}
+# if SUPPORTED_PERSONALITIES > 1
+	update_personality(tcp, pers);
+# endif
+	tcp->scno = scno;
+	set_sysent(tcp);
+
+	for (i = 0; i < MAX_ARGS; ++i) {
+		/* Zero-extend from 32 bits, like get_syscall_args() does */
+		if (!(info.arch & __AUDIT_ARCH_64BIT))
+			info.u.entry.args[i] = (uint32_t) info.u.entry.args[i];
+		tcp->u_arg[i] = info.u.entry.args[i];
+# ifdef X32
+		tcp->ext_arg[i] = info.u.entry.args[i];
+# endif
+	}
+
+	if (iflag || tcp->s_ent->sys_func == sys_sigreturn)
+		get_regs(tcp->pid);
+	return 1;
+}
+
+/* Syscall exit counterpart of get_syscall_result() and get_error() */
+static int
+syscall_info_exiting(struct tcb *tcp)
+{
+	struct syscall_info info;
+	long long rval;
+
+	if (!get_syscall_info(tcp, &info, PTRACE_SYSCALL_INFO_EXIT))
+		return 0;
+	rval = info.u.exit.rval;
+	/* Sign extend from 32 bits, like get_error() does */
+	if (!(info.arch & __AUDIT_ARCH_64BIT))
+		rval = (int32_t) rval;
+	if (info.u.exit.is_error
+	 && !(tcp->s_ent->sys_flags & SYSCALL_NEVER_FAILS)) {
+		tcp->u_rval = -1;
+		tcp->u_error = -rval;
+	} else {
+		tcp->u_rval = rval;
+# ifdef X32
+		tcp->u_lrval = rval;
+# endif
+		tcp->u_error = 0;
+	}
+
+	if (iflag)
+		get_regs(tcp->pid);
+	return 1;
+}
+
+#else /* !USE_SYSCALL_INFO */
+
+void
+init_syscall_info(void)
+{
+}
+
+# define syscall_info_entering(tcp) 0
+# define syscall_info_exiting(tcp) 0
+
+#endif /* !USE_SYSCALL_INFO */
+
 static int
 trace_syscall_entering(struct tcb *tcp)
 {
@@ -1967,15 +2224,26 @@ trace_syscall_entering(struct tcb *tcp)
 	}
 #endif
 
-	scno_good = res = (get_regs_error ? -1 : get_scno(tcp));
-	if (res == 0)
-		return res;
-	if (res == 1) {
-		res = syscall_fixup_on_sysenter(tcp);
+	if (capture_decoding) {
+		/* scno and u_arg[] have been loaded from the capture */
+#if SUPPORTED_PERSONALITIES > 1
+		update_personality(tcp, tcp->currpers);
+#endif
+		set_sysent(tcp);
+		scno_good = res = 1;
+	} else if (use_syscall_info && syscall_info_entering(tcp)) {
+		scno_good = res = 1;
+	} else {
+		scno_good = res = (get_regs_error ? -1 : get_scno(tcp));
 		if (res == 0)
 			return res;
-		if (res == 1)
-			res = get_syscall_args(tcp);
+		if (res == 1) {
+			res = syscall_fixup_on_sysenter(tcp);
+			if (res == 0)
+				return res;
+			if (res == 1)
+				res = get_syscall_args(tcp);
+		}
 	}
 
 	if (res != 1) {
@@ -1993,6 +2261,10 @@ trace_syscall_entering(struct tcb *tcp)
 		goto ret;
 	}
 
+	/* Record raw scno and u_arg[], before subcall decoding */
+	if (capture_enabled)
+		capture_begin(tcp, CAPTURE_ENTRY, 0);
+
 	if (   sys_execve == tcp->s_ent->sys_func
 # if defined(SPARC) || defined(SPARC64)
 	    || sys_execv == tcp->s_ent->sys_func
@@ -2046,12 +2318,19 @@ trace_syscall_entering(struct tcb *tcp)
 	else
 		res = tcp->s_ent->sys_func(tcp);
 
-	fflush(tcp->outf);
+	capture_end(tcp);
+	/*
+	 * Show the syscall entry right away, unless other tracers
+	 * write to the same log: only whole lines may be written then.
+	 * A binary capture is not meant to be watched.
+	 */
+	if (ntracers == 1 && !capture_enabled)
+		fflush(tcp->outf);
  ret:
 	tcp->flags |= TCB_INSYSCALL;
 	/* Measure the entrance time as late as possible to avoid errors. */
 	if (Tflag || cflag)
-		gettimeofday(&tcp->etime, NULL);
+		tcp->etime = capture_monotonic_ns();
 	return res;
 }
 
@@ -2463,37 +2742,155 @@ get_error(struct tcb *tcp)
 	tcp->u_error = u_error;
 }
 
+/*
+ * Roles of syscall arguments used by -P and by -e read/write,
+ * one character per argument:
+ *	f - file descriptor
+ *	p - path
+ *	a - path relative to the preceding file descriptor argument
+ *	s - fd_set, the number of fds is in the first argument
+ *	S - old select argument block
+ *	P - pollfd array, the number of entries is in the next argument
+ *	r - buffer read into, the number of bytes is the return value
+ *	w - buffer written from, the number of bytes is in the next argument
+ *	R - iovec array read into, the number of entries is in the next argument
+ *	W - iovec array written from, likewise
+ *	- - none of the above
+ * Syscalls not listed here take a path as the first argument if they
+ * have TRACE_FILE flag, or a file descriptor if they have TRACE_DESC
+ * or TRACE_NETWORK flag.
+ */
+static const struct {
+	int (*func)();
+	const char *roles;
+} arg_roles_table[] = {
+	{ sys_dup2,		"ff"	},
+	{ sys_dup3,		"ff"	},
+	{ sys_sendfile,		"ff"	},
+	{ sys_sendfile64,	"ff"	},
+	{ sys_tee,		"ff"	},
+	{ sys_splice,		"f-f"	},
+	{ sys_epoll_ctl,	"--f"	},
+	{ sys_inotify_add_watch, "fp"	},
+	{ sys_faccessat,	"fa"	},
+	{ sys_fchmodat,		"fa"	},
+	{ sys_futimesat,	"fa"	},
+	{ sys_mkdirat,		"fa"	},
+	{ sys_unlinkat,		"fa"	},
+	{ sys_newfstatat,	"fa"	},
+	{ sys_mknodat,		"fa"	},
+	{ sys_openat,		"fa"	},
+	{ sys_readlinkat,	"fa"	},
+	{ sys_utimensat,	"fa"	},
+	{ sys_fchownat,		"fa"	},
+	{ sys_renameat,		"fafa"	},
+	{ sys_linkat,		"fafa"	},
+	{ sys_symlinkat,	"pfa"	},
+	{ sys_fanotify_mark,	"---fa"	},
+	{ sys_link,		"pp"	},
+	{ sys_mount,		"pp"	},
+	{ sys_quotactl,		"-p"	},
+	{ sys_old_mmap,		"----f"	},
+#if defined(S390)
+	{ sys_old_mmap_pgoff,	"----f"	},
+#endif
+	{ sys_mmap,		"----f"	},
+	{ sys_mmap_pgoff,	"----f"	},
+	{ sys_mmap_4koff,	"----f"	},
+	{ sys_select,		"-sss"	},
+	{ sys_pselect6,		"-sss"	},
+	{ sys_oldselect,	"S"	},
+	{ sys_poll,		"P"	},
+	{ sys_ppoll,		"P"	},
+	{ sys_read,		"fr"	},
+	{ sys_pread,		"fr"	},
+	{ sys_recv,		"fr"	},
+	{ sys_recvfrom,		"fr"	},
+	{ sys_readv,		"fR"	},
+	{ sys_preadv,		"fR"	},
+	{ sys_write,		"fw"	},
+	{ sys_pwrite,		"fw"	},
+	{ sys_send,		"fw"	},
+	{ sys_sendto,		"fw"	},
+	{ sys_writev,		"fW"	},
+	{ sys_pwritev,		"fW"	},
+	/* These have no file descriptor or path arguments */
+	{ printargs,		""	},
+	{ sys_pipe,		""	},
+	{ sys_pipe2,		""	},
+	{ sys_eventfd,		""	},
+	{ sys_eventfd2,		""	},
+	{ sys_inotify_init1,	""	},
+	{ sys_timerfd_create,	""	},
+	{ sys_timerfd_settime,	""	},
+	{ sys_timerfd_gettime,	""	},
+	{ sys_epoll_create,	""	},
+	{ sys_socket,		""	},
+	{ sys_socketpair,	""	},
+	{ sys_fanotify_init,	""	},
+};
+
+static const char **arg_rolesv[SUPPORTED_PERSONALITIES];
+
+/*
+ * Return roles of arguments of the current syscall of tcp.
+ * They are looked up in arg_roles_table once per personality.
+ */
+const char *
+syscall_arg_roles(struct tcb *tcp)
+{
+	const char **roles = arg_rolesv[current_personality];
+	unsigned int i, j;
+
+	if (!roles) {
+		roles = malloc(nsyscalls * sizeof(*roles));
+		if (!roles)
+			die_out_of_memory();
+		for (i = 0; i < nsyscalls; i++) {
+			const struct_sysent *s = &sysent[i];
+
+			for (j = 0; j < ARRAY_SIZE(arg_roles_table); j++)
+				if (s->sys_func == arg_roles_table[j].func)
+					break;
+			if (j < ARRAY_SIZE(arg_roles_table))
+				roles[i] = arg_roles_table[j].roles;
+			else if (s->sys_flags & TRACE_FILE)
+				roles[i] = "p";
+			else if (s->sys_flags & (TRACE_DESC | TRACE_NETWORK))
+				roles[i] = "f";
+			else
+				roles[i] = "";
+		}
+		arg_rolesv[current_personality] = roles;
+	}
+	return SCNO_IN_RANGE(tcp->scno) ? roles[tcp->scno] : "";
+}
+
 static void
 dumpio(struct tcb *tcp)
 {
-	int (*func)();
+	const char *roles;
 
 	if (syserror(tcp))
 		return;
 	if ((unsigned long) tcp->u_arg[0] >= num_quals)
 		return;
-	func = tcp->s_ent->sys_func;
-	if (func == printargs)
+	if (!(qual_flags[tcp->u_arg[0]] & (QUAL_READ | QUAL_WRITE)))
+		return;
+	roles = syscall_arg_roles(tcp);
+	if (roles[0] != 'f' || !roles[1])
 		return;
 	if (qual_flags[tcp->u_arg[0]] & QUAL_READ) {
-		if (func == sys_read ||
-		    func == sys_pread ||
-		    func == sys_recv ||
-		    func == sys_recvfrom)
+		if (roles[1] == 'r')
 			dumpstr(tcp, tcp->u_arg[1], tcp->u_rval);
-		else if (func == sys_readv)
+		else if (roles[1] == 'R')
 			dumpiov(tcp, tcp->u_arg[2], tcp->u_arg[1]);
-		return;
 	}
 	if (qual_flags[tcp->u_arg[0]] & QUAL_WRITE) {
-		if (func == sys_write ||
-		    func == sys_pwrite ||
-		    func == sys_send ||
-		    func == sys_sendto)
+		if (roles[1] == 'w')
 			dumpstr(tcp, tcp->u_arg[1], tcp->u_arg[2]);
-		else if (func == sys_writev)
+		else if (roles[1] == 'W')
 			dumpiov(tcp, tcp->u_arg[2], tcp->u_arg[1]);
-		return;
 	}
 }
 
@@ -2501,45 +2898,61 @@ static int
 trace_syscall_exiting(struct tcb *tcp)
 {
 	int sys_res;
-	struct timeval tv;
+	uint64_t exit_ns = 0;
 	int res;
 	long u_error;
 
 	/* Measure the exit time as early as possible to avoid errors. */
 	if (Tflag || cflag)
-		gettimeofday(&tv, NULL);
+		exit_ns = capture_monotonic_ns();
 
 #if SUPPORTED_PERSONALITIES > 1
 	update_personality(tcp, tcp->currpers);
 #endif
-	res = (get_regs_error ? -1 : get_syscall_result(tcp));
+	if (capture_decoding) {
+		/* u_rval and u_error come from the capture */
+		res = 1;
+	} else if (use_syscall_info && syscall_info_exiting(tcp)) {
+		res = 1;
+	} else {
+		res = (get_regs_error ? -1 : get_syscall_result(tcp));
+		if (res == 1) {
+			syscall_fixup_on_sysexit(tcp); /* never fails */
+			get_error(tcp); /* never fails */
+		}
+	}
 	if (res == 1) {
-		syscall_fixup_on_sysexit(tcp); /* never fails */
-		get_error(tcp); /* never fails */
 		if (need_fork_exec_workarounds)
 			syscall_fixup_for_fork_exec(tcp);
+		if (fdcache_enabled)
+			fdcache_syscall_exit(tcp);
 		if (filtered(tcp) || hide_log_until_execve)
 			goto ret;
 	}
 
 	if (cflag) {
-		struct timeval t = tv;
-		count_syscall(tcp, &t);
+		count_syscall(tcp, exit_ns);
 		if (cflag == CFLAG_ONLY_STATS) {
 			goto ret;
 		}
 	}
 
+	if (capture_enabled && res == 1)
+		capture_begin(tcp, CAPTURE_EXIT, 0);
+
 	/* If not in -ff mode, and printing_tcp != tcp,
 	 * then the log currently does not end with output
 	 * of _our syscall entry_, but with something else.
 	 * We need to say which syscall's return is this.
+	 * With assembled lines, this happens only if our
+	 * entry has been written out unfinished.
 	 *
 	 * Forced reprinting via TCB_REPRINT is used only by
 	 * "strace -ff -oLOG test/threaded_execve" corner case.
 	 * It's the only case when -ff mode needs reprinting.
 	 */
-	if ((followfork < 2 && printing_tcp != tcp) || (tcp->flags & TCB_REPRINT)) {
+	if ((followfork < 2 && (assemble_lines ? tcp->curcol == 0 : printing_tcp != tcp))
+	    || (tcp->flags & TCB_REPRINT)) {
 		tcp->flags &= ~TCB_REPRINT;
 		printleader(tcp);
 		if (tcp->qual_flg & UNDEFINED_SCNO)
@@ -2699,12 +3112,14 @@ trace_syscall_exiting(struct tcb *tcp)
 			tprintf(" (%s)", tcp->auxstr);
 	}
 	if (Tflag) {
-		tv_sub(&tv, &tv, &tcp->etime);
-		tprintf(" <%ld.%06ld>",
-			(long) tv.tv_sec, (long) tv.tv_usec);
+		uint64_t ns = exit_ns - tcp->etime;
+
+		tprintf(" <%lu.%09lu>", (unsigned long) (ns / 1000000000),
+			(unsigned long) (ns % 1000000000));
 	}
 	tprints("\n");
 	dumpio(tcp);
+	capture_end(tcp);
 	line_ended();
 
  ret:
@@ -0,0 +1,94 @@
+/* Measure the cost of a ptrace stop with many traced threads.
+ *
+ * Starts N (default 4000) threads which block in read() on a pipe,
+ * then one more thread (the most recently created tracee, which is
+ * the worst case for a linear search) issues getppid() M (default 100000)
+ * times and reports the average time per syscall.
+ * Compare the numbers with and without strace, and between strace versions:
+ *
+ * gcc -O2 -o test/many_threads test/many_threads.c -pthread
+ * ./strace -f -e trace=none ./test/many_threads 4000 100000
+ * ./strace -f -e trace=none ./test/many_threads 40 100000
+ *
+ * With pid lookups independent of the number of tracees, the per-syscall
+ * cost of both runs should be roughly the same.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static int pipefd[2];
+static long nloops;
+
+static void *thread(void *arg)
+{
+	char c;
+
+	if (read(pipefd[0], &c, 1) < 0)
+		perror("read");
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *worker(void *arg)
+{
+	double start, stop;
+	long i;
+
+	start = now();
+	for (i = 0; i < nloops; i++)
+		getppid();
+	stop = now();
+	*(double *) arg = (stop - start) / nloops;
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	int nthreads = argc > 1 ? atoi(argv[1]) : 4000;
+	pthread_t *threads, worker_thread;
+	pthread_attr_t attr;
+	double cost;
+	long i;
+
+	nloops = argc > 2 ? atol(argv[2]) : 100000;
+	threads = calloc(nthreads, sizeof(threads[0]));
+	if (!threads || pipe(pipefd) < 0) {
+		perror("setup");
+		return 1;
+	}
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN > 65536 ? PTHREAD_STACK_MIN : 65536);
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], &attr, thread, NULL) != 0) {
+			fprintf(stderr, "pthread_create failed after %ld threads\n", i);
+			nthreads = i;
+			break;
+		}
+	}
+
+	if (pthread_create(&worker_thread, &attr, worker, &cost) != 0) {
+		fprintf(stderr, "pthread_create failed\n");
+		return 1;
+	}
+	pthread_join(worker_thread, NULL);
+
+	if (close(pipefd[1]) < 0)
+		perror("close");
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	printf("%d threads: %.0f ns per syscall\n", nthreads, cost);
+	return 0;
+}
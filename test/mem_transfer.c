@@ -0,0 +1,128 @@
+/* Compare the ways strace can read tracee memory.
+ *
+ * Stops a child with a buffer of SIZE bytes under ptrace, then reads
+ * the buffer many times with each of:
+ * process_vm_readv, pread from /proc/PID/mem, PTRACE_PEEKDATA,
+ * and reports the average time per read for buffer sizes from 8 bytes
+ * up to SIZE (default 65536):
+ *
+ * gcc -O2 -o test/mem_transfer test/mem_transfer.c
+ * ./test/mem_transfer 65536
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+static pid_t pid;
+static char *buf;
+static char *copy;
+static int mem_fd;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_vm_readv(size_t size)
+{
+	struct iovec local = { copy, size }, remote = { buf, size };
+
+	return process_vm_readv(pid, &local, 1, &remote, 1, 0) == (ssize_t) size;
+}
+
+static int read_proc_mem(size_t size)
+{
+	return pread(mem_fd, copy, size, (unsigned long) buf) == (ssize_t) size;
+}
+
+static int read_peekdata(size_t size)
+{
+	size_t i;
+	long val;
+
+	for (i = 0; i < size; i += sizeof(long)) {
+		errno = 0;
+		val = ptrace(PTRACE_PEEKDATA, pid, buf + i, 0);
+		if (errno)
+			return 0;
+		memcpy(copy + i, &val, sizeof(long));
+	}
+	return 1;
+}
+
+static void measure(int (*func)(size_t), size_t size)
+{
+	/* Keep the total amount of data roughly the same for all sizes */
+	long i, loops = 4000 + (64L << 20) / size / 16;
+	double t;
+
+	if (!func(size)) {
+		printf(" %14s", "failed");
+		return;
+	}
+	t = now();
+	for (i = 0; i < loops; i++)
+		func(size);
+	t = now() - t;
+	printf(" %11.2f us", t / loops * 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	size_t max = argc > 1 ? strtoul(argv[1], NULL, 0) : 65536;
+	size_t size;
+	char path[64];
+
+	max = (max + sizeof(long) - 1) & -sizeof(long);
+	buf = malloc(max);
+	copy = malloc(max);
+	if (!buf || !copy)
+		return 1;
+	memset(buf, 'x', max);
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid == 0) {
+		/* buf is at the same address in the child */
+		ptrace(PTRACE_TRACEME, 0, 0, 0);
+		raise(SIGSTOP);
+		_exit(0);
+	}
+	if (waitpid(pid, NULL, 0) != pid) {
+		perror("waitpid");
+		return 1;
+	}
+	sprintf(path, "/proc/%d/mem", pid);
+	mem_fd = open(path, O_RDONLY);
+	if (mem_fd < 0)
+		perror(path);
+
+	printf("%8s %14s %14s %14s\n",
+	       "size", "vm_readv", "/proc/PID/mem", "PEEKDATA");
+	for (size = 8; size <= max; size *= 2) {
+		printf("%8zu", size);
+		measure(read_vm_readv, size);
+		measure(read_proc_mem, size);
+		measure(read_peekdata, size);
+		printf("\n");
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	return 0;
+}
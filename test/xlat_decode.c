@@ -0,0 +1,59 @@
+/* Workload for timing the decoders.
+ *
+ * Makes LOOPS (default 20000) rounds of syscalls whose arguments are
+ * mostly flags and symbolic constants: open, mmap, mprotect, fcntl,
+ * socket options, signal masks and actions.  Capture it once, then time
+ * only the decoding, which does not depend on ptrace:
+ *
+ * gcc -O2 -o test/xlat_decode test/xlat_decode.c
+ * ./strace --binary -o cap ./test/xlat_decode
+ * time ./strace --decode=cap -o /dev/null
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+int main(int argc, char **argv)
+{
+	long i, loops = argc > 1 ? strtol(argv[1], NULL, 0) : 20000;
+	struct sigaction sa = { .sa_handler = SIG_IGN };
+	sigset_t set;
+	int one = 1;
+	int fd, s;
+	void *p;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	sigaddset(&set, SIGCHLD);
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+
+	for (i = 0; i < loops; i++) {
+		fd = open("/dev/null", O_RDWR | O_CLOEXEC | O_NONBLOCK | O_NOCTTY);
+		fcntl(fd, F_SETFL, O_APPEND | O_NONBLOCK);
+		fcntl(fd, F_GETFD);
+		close(fd);
+
+		p = mmap(NULL, 4096, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		mprotect(p, 4096, PROT_READ);
+		madvise(p, 4096, MADV_DONTNEED);
+		munmap(p, 4096);
+
+		s = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		close(s);
+
+		sigprocmask(SIG_BLOCK, &set, NULL);
+		sigprocmask(SIG_UNBLOCK, &set, NULL);
+		sigaction(SIGUSR2, &sa, NULL);
+		access("/nonexistent", R_OK | W_OK);
+	}
+	return 0;
+}
@@ -0,0 +1,19 @@
+/*
+ * Call fcntl F_GETFD 5 times and F_SETFD 3 times,
+ * for strace -c to break fcntl down by command.
+ */
+#include <fcntl.h>
+
+int
+main(void)
+{
+	int i;
+
+	for (i = 0; i < 5; ++i)
+		if (fcntl(0, F_GETFD) < 0)
+			return 77;
+	for (i = 0; i < 3; ++i)
+		if (fcntl(0, F_SETFD, 0) < 0)
+			return 77;
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Compare plain_prefix() as strace is built, which uses SSE2 if it is
+ * available, with its scalar version and with a byte-at-a-time
+ * reference, on random buffers of every length and alignment
+ * up to a few SSE2 blocks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../plain_prefix.h"
+#undef __SSE2__
+#define plain_prefix plain_prefix_scalar
+#include "../plain_prefix.h"
+#undef plain_prefix
+
+#define MAX_LEN 80
+#define ALIGN 16
+#define COUNT 20000
+
+static int
+reference(const unsigned char *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; ++i)
+		if (buf[i] < ' ' || buf[i] > 0x7e ||
+		    buf[i] == '"' || buf[i] == '\\')
+			break;
+	return i;
+}
+
+/* Bytes at the edges of the printable range are the likely mistakes */
+static const unsigned char special[] = {
+	0, '\t', '\n', ' ' - 1, ' ', '"', '\\', 0x7e, 0x7f, 0x80, 0xff
+};
+
+int
+main(void)
+{
+	unsigned char buf[ALIGN + MAX_LEN];
+	int n, len, off, i, exp, fast, scalar;
+
+	srand(1);
+	for (n = 0; n < COUNT; ++n) {
+		for (i = 0; i < (int) sizeof(buf); ++i)
+			buf[i] = ' ' + 1 + rand() % (0x7e - ' ');
+		/* One special byte in most buffers, a few in some */
+		for (i = rand() % 4; i > 0; --i)
+			buf[rand() % sizeof(buf)] =
+				special[rand() % sizeof(special)];
+		for (off = 0; off < ALIGN; ++off) {
+			for (len = 0; len <= MAX_LEN; ++len) {
+				exp = reference(buf + off, len);
+				fast = plain_prefix(buf + off, len);
+				scalar = plain_prefix_scalar(buf + off, len);
+				if (fast == exp && scalar == exp)
+					continue;
+				fprintf(stderr, "plain_prefix of %d bytes at"
+					" offset %d: %d, scalar %d, expected"
+					" %d\n", len, off, fast, scalar, exp);
+				for (i = 0; i < len; ++i)
+					fprintf(stderr, "%02x", buf[off + i]);
+				fputc('\n', stderr);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Write random buffers to /dev/null on descriptor 3 and print on stdout how strace
+ * is expected to quote each of them, one per line.
+ * The quoting rules are a plain byte-at-a-time copy of the original
+ * string_quote(), kept here as the reference for the fast path.
+ *
+ * Usage: string-quote XFLAG SEED, where XFLAG is the number of -x
+ * options strace is run with.
+ *
+ * string-quote partial writes a page of 'a' followed by an unmapped page
+ * instead, and prints how strace run with -s longer than a page
+ * is expected to quote it.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MAX_LEN 10000
+#define COUNT 400
+
+static int
+needs_hex(const unsigned char *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; ++i) {
+		if (buf[i] > 0x7e)
+			return 1;
+		if (buf[i] < ' ' && (unsigned) (buf[i] - 9) >= 5)
+			return 1;
+	}
+	return 0;
+}
+
+static void
+quote(const unsigned char *buf, int len, int usehex)
+{
+	int c, i;
+
+	putchar('"');
+	for (i = 0; i < len; ++i) {
+		c = buf[i];
+		if (usehex) {
+			printf("\\x%02x", c);
+			continue;
+		}
+		switch (c) {
+		case '"': case '\\':
+			printf("\\%c", c);
+			break;
+		case '\f':
+			printf("\\f");
+			break;
+		case '\n':
+			printf("\\n");
+			break;
+		case '\r':
+			printf("\\r");
+			break;
+		case '\t':
+			printf("\\t");
+			break;
+		case '\v':
+			printf("\\v");
+			break;
+		default:
+			if (c >= ' ' && c <= 0x7e)
+				putchar(c);
+			else if (i + 1 < len && buf[i + 1] >= '0' &&
+				 buf[i + 1] <= '9')
+				printf("\\%03o", c);
+			else
+				printf("\\%o", c);
+			break;
+		}
+	}
+	printf("\"\n");
+}
+
+/* Mostly printable text with occasional bytes of the given kind */
+static void
+fill(unsigned char *buf, int len, int kind)
+{
+	static const char special[] = "\"\\\t\n\v\f\r";
+	int i;
+
+	for (i = 0; i < len; ++i) {
+		buf[i] = ' ' + rand() % 95;
+		if (kind == 0 || rand() % 64)
+			continue;
+		switch (kind) {
+		case 1:
+			buf[i] = special[rand() % (sizeof(special) - 1)];
+			break;
+		case 2:
+			/* Control byte, often followed by a digit */
+			buf[i] = rand() % 32;
+			if (i + 1 < len && rand() % 2)
+				buf[++i] = '0' + rand() % 10;
+			break;
+		default:
+			buf[i] = rand() % 256;
+			break;
+		}
+	}
+}
+
+/* The second chunk of the string cannot be read */
+static int
+partial(int fd)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned char *p;
+
+	p = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED || munmap(p + page, page))
+		return 1;
+	memset(p, 'a', page);
+	/* /dev/null does not read it, only strace does */
+	if (write(fd, p, page + 5000) != page + 5000)
+		return 1;
+	quote(p, page, 0);
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	static unsigned char buf[MAX_LEN];
+	int xflag, fd, i, len;
+
+	if (argc == 2 && strcmp(argv[1], "partial") == 0) {
+		fd = open("/dev/null", O_WRONLY);
+		if (fd < 0 || (fd != 3 && dup2(fd, 3) != 3))
+			return 1;
+		return partial(3);
+	}
+	if (argc != 3)
+		return 2;
+	xflag = atoi(argv[1]);
+	srand(atoi(argv[2]));
+	fd = open("/dev/null", O_WRONLY);
+	if (fd < 0 || (fd != 3 && dup2(fd, 3) != 3))
+		return 1;
+	fd = 3;
+
+	for (i = 0; i < COUNT; ++i) {
+		/* Short ones around the vector width, then long ones */
+		len = rand() % (i % 4 ? 80 : MAX_LEN);
+		fill(buf, len, rand() % 4);
+		if (write(fd, buf, len) != len)
+			return 1;
+		quote(buf, len, xflag > 1 || (xflag && needs_hex(buf, len)));
+	}
+	return 0;
+}
@@ -38,6 +38,10 @@
 #if HAVE_SYS_UIO_H
 # include <sys/uio.h>
 #endif
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#include "plain_prefix.h"
 
 #if defined(IA64)
 # include <asm/ptrace_offsets.h>
@@ -78,71 +82,243 @@ string_to_uint(const char *str)
 	return (int)value;
 }
 
-int
-tv_nz(struct timeval *a)
+/*
+ * Durations are measured in nanoseconds of CLOCK_MONOTONIC, which is
+ * not affected by changes of the system time.
+ */
+uint64_t
+monotonic_ns(void)
 {
-	return a->tv_sec || a->tv_usec;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
-int
-tv_cmp(struct timeval *a, struct timeval *b)
+uint64_t
+timeval_ns(const struct timeval *tv)
 {
-	if (a->tv_sec < b->tv_sec
-	    || (a->tv_sec == b->tv_sec && a->tv_usec < b->tv_usec))
-		return -1;
-	if (a->tv_sec > b->tv_sec
-	    || (a->tv_sec == b->tv_sec && a->tv_usec > b->tv_usec))
-		return 1;
-	return 0;
+	return tv->tv_sec * 1000000000ULL + tv->tv_usec * 1000ULL;
 }
 
-double
-tv_float(struct timeval *tv)
+/*
+ * Indexes of xlat tables.  Tables are plain arrays scattered over
+ * the decoders, so instead of scanning them on every lookup, an index
+ * is built for each table the first time it is used and found again
+ * by the address of the table.
+ *
+ * Value lookups use an array indexed by (val - min) when the values
+ * are dense, and a sorted array otherwise.  Flag tables whose non-zero
+ * values are all single bits map each bit to its entry, so decoding
+ * costs one step per set bit instead of one per table entry.
+ * Small tables are still scanned.  Where values repeat, the index
+ * keeps the first entry, like the scan does.
+ */
+#define XLAT_INDEX_MIN	8	/* smaller tables are scanned */
+#define XLAT_MAX_ZERO	4	/* zero entries kept by a flags index */
+#define XLAT_MAX_MATCH	(32 + XLAT_MAX_ZERO)
+
+struct xlat_index {
+	const struct xlat *xlat;
+	unsigned int min;
+	unsigned int range;		/* number of elements in direct[] */
+	const char **direct;
+	unsigned int nsorted;
+	const struct xlat **sorted;
+	bool by_bit;
+	unsigned int nzero;
+	unsigned short zero[XLAT_MAX_ZERO];
+	short bit[32];			/* entry for each bit, -1 if none */
+};
+
+static struct xlat_index **xlat_indexes;
+static unsigned int xlat_indexes_size;	/* power of 2 */
+static unsigned int xlat_indexes_used;
+
+static unsigned int
+xlat_hash(const struct xlat *xlat)
 {
-	return tv->tv_sec + tv->tv_usec/1000000.0;
+	return ((unsigned long) xlat >> 3) * 2654435761U;
 }
 
-void
-tv_add(struct timeval *tv, struct timeval *a, struct timeval *b)
+static int
+xlat_cmp(const void *a, const void *b)
+{
+	const struct xlat *x = *(const struct xlat **) a;
+	const struct xlat *y = *(const struct xlat **) b;
+
+	/* Equal values are kept in table order */
+	if (x->val != y->val)
+		return (unsigned int) x->val < (unsigned int) y->val ? -1 : 1;
+	return x < y ? -1 : x > y;
+}
+
+static void
+build_xlat_index(struct xlat_index *xi, const struct xlat *xlat)
 {
-	tv->tv_sec = a->tv_sec + b->tv_sec;
-	tv->tv_usec = a->tv_usec + b->tv_usec;
-	if (tv->tv_usec >= 1000000) {
-		tv->tv_sec++;
-		tv->tv_usec -= 1000000;
+	unsigned int n, i, min, max;
+	const char **direct;
+
+	memset(xi, 0, sizeof(*xi));
+	xi->xlat = xlat;
+	for (n = 0; xlat[n].str; n++)
+		;
+	if (n < XLAT_INDEX_MIN)
+		return;
+
+	min = max = xlat[0].val;
+	for (i = 1; i < n; i++) {
+		if ((unsigned int) xlat[i].val < min)
+			min = xlat[i].val;
+		if ((unsigned int) xlat[i].val > max)
+			max = xlat[i].val;
+	}
+	if (max - min < 4 * n) {
+		direct = calloc(max - min + 1, sizeof(*direct));
+		if (!direct)
+			die_out_of_memory();
+		for (i = n; i-- > 0; )
+			direct[xlat[i].val - min] = xlat[i].str;
+		xi->min = min;
+		xi->range = max - min + 1;
+		xi->direct = direct;
+	} else {
+		xi->sorted = malloc(n * sizeof(*xi->sorted));
+		if (!xi->sorted)
+			die_out_of_memory();
+		for (i = 0; i < n; i++)
+			xi->sorted[i] = &xlat[i];
+		qsort(xi->sorted, n, sizeof(*xi->sorted), xlat_cmp);
+		xi->nsorted = n;
+	}
+
+	for (i = 0; i < 32; i++)
+		xi->bit[i] = -1;
+	for (i = 0; i < n; i++) {
+		unsigned int v = xlat[i].val;
+
+		if (v == 0) {
+			if (xi->nzero == XLAT_MAX_ZERO)
+				return;
+			xi->zero[xi->nzero++] = i;
+		} else if (v & (v - 1)) {
+			return;
+		} else if (xi->bit[ffs(v) - 1] < 0) {
+			xi->bit[ffs(v) - 1] = i;
+		}
 	}
+	xi->by_bit = true;
 }
 
-void
-tv_sub(struct timeval *tv, struct timeval *a, struct timeval *b)
+static const struct xlat_index *
+get_xlat_index(const struct xlat *xlat)
 {
-	tv->tv_sec = a->tv_sec - b->tv_sec;
-	tv->tv_usec = a->tv_usec - b->tv_usec;
-	if (((long) tv->tv_usec) < 0) {
-		tv->tv_sec--;
-		tv->tv_usec += 1000000;
+	struct xlat_index *xi;
+	unsigned int i, mask;
+
+	if (xlat_indexes_used * 2 >= xlat_indexes_size) {
+		struct xlat_index **old = xlat_indexes;
+		unsigned int old_size = xlat_indexes_size;
+
+		xlat_indexes_size = old_size ? old_size * 2 : 256;
+		xlat_indexes = calloc(xlat_indexes_size, sizeof(*xlat_indexes));
+		if (!xlat_indexes)
+			die_out_of_memory();
+		mask = xlat_indexes_size - 1;
+		for (i = 0; i < old_size; i++) {
+			unsigned int j;
+
+			if (!old[i])
+				continue;
+			for (j = xlat_hash(old[i]->xlat) & mask; xlat_indexes[j];
+			     j = (j + 1) & mask)
+				;
+			xlat_indexes[j] = old[i];
+		}
+		free(old);
 	}
+
+	mask = xlat_indexes_size - 1;
+	for (i = xlat_hash(xlat) & mask; xlat_indexes[i]; i = (i + 1) & mask)
+		if (xlat_indexes[i]->xlat == xlat)
+			return xlat_indexes[i];
+
+	xi = malloc(sizeof(*xi));
+	if (!xi)
+		die_out_of_memory();
+	build_xlat_index(xi, xlat);
+	xlat_indexes[i] = xi;
+	xlat_indexes_used++;
+	return xi;
 }
 
-void
-tv_div(struct timeval *tv, struct timeval *a, int n)
+/*
+ * Store in `match' the entries of a table indexed by bit which can match
+ * `flags', in table order, and return their number, or -1 if the table
+ * has to be scanned.  Zero entries are included if `zero' is set.
+ */
+static int
+xlat_flag_entries(const struct xlat *xlat, unsigned int flags, bool zero,
+		  const struct xlat **match)
 {
-	tv->tv_usec = (a->tv_sec % n * 1000000 + a->tv_usec + n / 2) / n;
-	tv->tv_sec = a->tv_sec / n + tv->tv_usec / 1000000;
-	tv->tv_usec %= 1000000;
+	const struct xlat_index *xi = get_xlat_index(xlat);
+	unsigned short idx[XLAT_MAX_MATCH];
+	unsigned int n = 0, i, j;
+
+	if (!xi->by_bit)
+		return -1;
+	if (zero)
+		for (; n < xi->nzero; n++)
+			idx[n] = xi->zero[n];
+	for (; flags; flags &= flags - 1) {
+		int e = xi->bit[ffs(flags) - 1];
+
+		if (e < 0)
+			continue;
+		for (i = n++; i > 0 && idx[i - 1] > e; i--)
+			idx[i] = idx[i - 1];
+		idx[i] = e;
+	}
+	for (j = 0; j < n; j++)
+		match[j] = &xlat[idx[j]];
+	return n;
 }
 
-void
-tv_mul(struct timeval *tv, struct timeval *a, int n)
+/* The i-th entry to check: either from `match' or from the whole table */
+static inline const struct xlat *
+flag_entry(const struct xlat *xlat, const struct xlat **match, int n, int i)
 {
-	tv->tv_usec = a->tv_usec * n;
-	tv->tv_sec = a->tv_sec * n + tv->tv_usec / 1000000;
-	tv->tv_usec %= 1000000;
+	if (n < 0)
+		return xlat[i].str ? &xlat[i] : NULL;
+	return i < n ? match[i] : NULL;
 }
 
 const char *
 xlookup(const struct xlat *xlat, int val)
 {
+	const struct xlat_index *xi = get_xlat_index(xlat);
+
+	if (xi->direct) {
+		unsigned int i = (unsigned int) val - xi->min;
+
+		return i < xi->range ? xi->direct[i] : NULL;
+	}
+	if (xi->sorted) {
+		unsigned int lo = 0, hi = xi->nsorted;
+
+		/* Find the first entry with xlat->val >= val */
+		while (lo < hi) {
+			unsigned int mid = (lo + hi) / 2;
+
+			if ((unsigned int) xi->sorted[mid]->val < (unsigned int) val)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo < xi->nsorted && xi->sorted[lo]->val == val)
+			return xi->sorted[lo]->str;
+		return NULL;
+	}
 	for (; xlat->str != NULL; xlat++)
 		if (xlat->val == val)
 			return xlat->str;
@@ -279,10 +455,15 @@ printllval(struct tcb *tcp, const char *format, int arg_no)
 void
 addflags(const struct xlat *xlat, int flags)
 {
-	for (; xlat->str; xlat++) {
-		if (xlat->val && (flags & xlat->val) == xlat->val) {
-			tprintf("|%s", xlat->str);
-			flags &= ~xlat->val;
+	const struct xlat *match[XLAT_MAX_MATCH];
+	const struct xlat *x;
+	int n, i;
+
+	n = xlat_flag_entries(xlat, flags, false, match);
+	for (i = 0; (x = flag_entry(xlat, match, n, i)); i++) {
+		if (x->val && (flags & x->val) == x->val) {
+			tprintf("|%s", x->str);
+			flags &= ~x->val;
 		}
 	}
 	if (flags) {
@@ -301,16 +482,20 @@ sprintflags(const char *prefix, const struct xlat *xlat, int flags)
 	static char outstr[1024];
 	char *outptr;
 	int found = 0;
+	const struct xlat *match[XLAT_MAX_MATCH];
+	const struct xlat *x;
+	int n, i;
 
 	outptr = stpcpy(outstr, prefix);
 
-	for (; xlat->str; xlat++) {
-		if ((flags & xlat->val) == xlat->val) {
+	n = xlat_flag_entries(xlat, flags, true, match);
+	for (i = 0; (x = flag_entry(xlat, match, n, i)); i++) {
+		if ((flags & x->val) == x->val) {
 			if (found)
 				*outptr++ = '|';
-			outptr = stpcpy(outptr, xlat->str);
+			outptr = stpcpy(outptr, x->str);
 			found = 1;
-			flags &= ~xlat->val;
+			flags &= ~x->val;
 			if (!flags)
 				break;
 		}
@@ -329,6 +514,9 @@ printflags(const struct xlat *xlat, int flags, const char *dflt)
 {
 	int n;
 	const char *sep;
+	const struct xlat *match[XLAT_MAX_MATCH];
+	const struct xlat *x;
+	int nmatch, i;
 
 	if (flags == 0 && xlat->val == 0) {
 		tprints(xlat->str);
@@ -336,10 +524,11 @@ printflags(const struct xlat *xlat, int flags, const char *dflt)
 	}
 
 	sep = "";
-	for (n = 0; xlat->str; xlat++) {
-		if (xlat->val && (flags & xlat->val) == xlat->val) {
-			tprintf("%s%s", sep, xlat->str);
-			flags &= ~xlat->val;
+	nmatch = xlat_flag_entries(xlat, flags, false, match);
+	for (n = i = 0; (x = flag_entry(xlat, match, nmatch, i)); i++) {
+		if (x->val && (flags & x->val) == x->val) {
+			tprintf("%s%s", sep, x->str);
+			flags &= ~x->val;
 			sep = "|";
 			n++;
 		}
@@ -417,6 +606,120 @@ printuid(const char *text, unsigned long uid)
 	tprintf((uid == -1) ? "%s%ld" : "%s%lu", text, uid);
 }
 
+/*
+ * Return true if the string needs to be hex-quoted with -x:
+ * it has bytes which are neither printable nor whitespace.
+ */
+static int
+string_needs_hex(const unsigned char *ustr, int size)
+{
+	int i, c;
+
+	for (i = 0; i < size; ++i) {
+		i += plain_prefix(ustr + i, size - i);
+		if (i == size)
+			break;
+		c = ustr[i];
+		/* Force hex unless c is printable or whitespace */
+		if (c > 0x7e)
+			return 1;
+		/* In ASCII isspace is only these chars: "\t\n\v\f\r".
+		 * They happen to have ASCII codes 9,10,11,12,13.
+		 */
+		if (c < ' ' && (unsigned)(c - 9) >= 5)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Quote `size' bytes of `ustr' to `s', without the surrounding quotes.
+ * Writes up to (`size' * 4) bytes and returns the end of the output.
+ * `next' is the byte that follows in the string, or -1 if there is none:
+ * a byte printed in octal gets all three digits when a digit follows it.
+ * If `usehex' is -1, the string is hex-quoted if it needs to be with -x:
+ * NULL is returned as soon as this is found, and the caller quotes
+ * the string again with `usehex' set.
+ */
+static char *
+quote_bytes(const unsigned char *ustr, int size, int next, int usehex,
+	    char *s)
+{
+	int c, i, n, lookahead;
+
+	if (usehex > 0) {
+		/* Hex-quote the whole string. */
+		for (i = 0; i < size; ++i) {
+			c = ustr[i];
+			*s++ = '\\';
+			*s++ = 'x';
+			*s++ = "0123456789abcdef"[c >> 4];
+			*s++ = "0123456789abcdef"[c & 0xf];
+		}
+		return s;
+	}
+
+	for (i = 0; i < size; ++i) {
+		/* Copy runs of bytes which need no quoting at once */
+		n = plain_prefix(ustr + i, size - i);
+		memcpy(s, ustr + i, n);
+		s += n;
+		i += n;
+		if (i == size)
+			break;
+
+		c = ustr[i];
+		switch (c) {
+			case '\"': case '\\':
+				*s++ = '\\';
+				*s++ = c;
+				break;
+			case '\f':
+				*s++ = '\\';
+				*s++ = 'f';
+				break;
+			case '\n':
+				*s++ = '\\';
+				*s++ = 'n';
+				break;
+			case '\r':
+				*s++ = '\\';
+				*s++ = 'r';
+				break;
+			case '\t':
+				*s++ = '\\';
+				*s++ = 't';
+				break;
+			case '\v':
+				*s++ = '\\';
+				*s++ = 'v';
+				break;
+			default:
+				/* Neither printable nor whitespace */
+				if (usehex < 0)
+					return NULL;
+				/* Print \octal */
+				*s++ = '\\';
+				lookahead = i + 1 < size ? ustr[i + 1] : next;
+				if (lookahead >= '0' && lookahead <= '9') {
+					/* Print \ooo */
+					*s++ = '0' + (c >> 6);
+					*s++ = '0' + ((c >> 3) & 0x7);
+				} else {
+					/* Print \[[o]o]o */
+					if ((c >> 3) != 0) {
+						if ((c >> 6) != 0)
+							*s++ = '0' + (c >> 6);
+						*s++ = '0' + ((c >> 3) & 0x7);
+					}
+				}
+				*s++ = '0' + (c & 0x7);
+				break;
+		}
+	}
+	return s;
+}
+
 /*
  * Quote string `instr' of length `size'
  * Write up to (3 + `size' * 4) bytes to `outstr' buffer.
@@ -430,133 +733,36 @@ int
 string_quote(const char *instr, char *outstr, long len, int size)
 {
 	const unsigned char *ustr = (const unsigned char *) instr;
-	char *s = outstr;
-	int usehex, c, i, eol;
+	const unsigned char *nul;
+	char *s = outstr, *e;
+	int n, usehex;
 
-	eol = 0x100; /* this can never match a char */
+	n = size;
 	if (len == -1) {
 		size--;
-		eol = '\0';
+		nul = memchr(ustr, '\0', size);
+		n = nul ? nul - ustr : size;
 	}
 
 	usehex = 0;
 	if (xflag > 1)
 		usehex = 1;
-	else if (xflag) {
-		/* Check for presence of symbol which require
-		   to hex-quote the whole string. */
-		for (i = 0; i < size; ++i) {
-			c = ustr[i];
-			/* Check for NUL-terminated string. */
-			if (c == eol)
-				break;
-
-			/* Force hex unless c is printable or whitespace */
-			if (c > 0x7e) {
-				usehex = 1;
-				break;
-			}
-			/* In ASCII isspace is only these chars: "\t\n\v\f\r".
-			 * They happen to have ASCII codes 9,10,11,12,13.
-			 */
-			if (c < ' ' && (unsigned)(c - 9) >= 5) {
-				usehex = 1;
-				break;
-			}
-		}
-	}
+	else if (xflag)
+		usehex = -1;
 
 	*s++ = '\"';
-
-	if (usehex) {
-		/* Hex-quote the whole string. */
-		for (i = 0; i < size; ++i) {
-			c = ustr[i];
-			/* Check for NUL-terminated string. */
-			if (c == eol)
-				goto asciz_ended;
-			*s++ = '\\';
-			*s++ = 'x';
-			*s++ = "0123456789abcdef"[c >> 4];
-			*s++ = "0123456789abcdef"[c & 0xf];
-		}
-	} else {
-		for (i = 0; i < size; ++i) {
-			c = ustr[i];
-			/* Check for NUL-terminated string. */
-			if (c == eol)
-				goto asciz_ended;
-			switch (c) {
-				case '\"': case '\\':
-					*s++ = '\\';
-					*s++ = c;
-					break;
-				case '\f':
-					*s++ = '\\';
-					*s++ = 'f';
-					break;
-				case '\n':
-					*s++ = '\\';
-					*s++ = 'n';
-					break;
-				case '\r':
-					*s++ = '\\';
-					*s++ = 'r';
-					break;
-				case '\t':
-					*s++ = '\\';
-					*s++ = 't';
-					break;
-				case '\v':
-					*s++ = '\\';
-					*s++ = 'v';
-					break;
-				default:
-					if (c >= ' ' && c <= 0x7e)
-						*s++ = c;
-					else {
-						/* Print \octal */
-						*s++ = '\\';
-						if (i + 1 < size
-						    && ustr[i + 1] >= '0'
-						    && ustr[i + 1] <= '9'
-						) {
-							/* Print \ooo */
-							*s++ = '0' + (c >> 6);
-							*s++ = '0' + ((c >> 3) & 0x7);
-						} else {
-							/* Print \[[o]o]o */
-							if ((c >> 3) != 0) {
-								if ((c >> 6) != 0)
-									*s++ = '0' + (c >> 6);
-								*s++ = '0' + ((c >> 3) & 0x7);
-							}
-						}
-						*s++ = '0' + (c & 0x7);
-					}
-					break;
-			}
-		}
-	}
-
+	e = quote_bytes(ustr, n, -1, usehex, s);
+	if (!e)
+		e = quote_bytes(ustr, n, -1, 1, s);
+	s = e;
 	*s++ = '\"';
 	*s = '\0';
 
 	/* Return zero if we printed entire ASCIZ string (didn't truncate it) */
-	if (len == -1 && ustr[i] == '\0') {
-		/* We didn't see NUL yet (otherwise we'd jump to 'asciz_ended')
-		 * but next char is NUL.
-		 */
+	if (len == -1 && (n < size || ustr[size] == '\0'))
 		return 0;
-	}
 
 	return 1;
-
- asciz_ended:
-	*s++ = '\"';
-	*s = '\0';
-	/* Return zero: we printed entire ASCIZ string (didn't truncate it) */
-	return 0;
 }
 
 /*
@@ -583,15 +789,17 @@ printpathn(struct tcb *tcp, long addr, int n)
 	if (nul_seen < 0)
 		tprintf("%#lx", addr);
 	else {
+		void *mark = arena_mark();
 		char *outstr;
 
 		path[n] = '\0';
 		n++;
-		outstr = alloca(4 * n); /* 4*(n-1) + 3 for quotes and NUL */
+		outstr = arena_alloc(4 * n); /* 4*(n-1) + 3 for quotes and NUL */
 		string_quote(path, outstr, -1, n);
 		tprints(outstr);
 		if (!nul_seen)
 			tprints("...");
+		arena_release(mark);
 	}
 }
 
@@ -602,67 +810,282 @@ printpath(struct tcb *tcp, long addr)
 	printpathn(tcp, addr, MAXPATHLEN);
 }
 
+/* Strings are read and quoted in pieces of this size */
+#define PRINTSTR_CHUNK 4096
+
+/*
+ * Read `total' bytes of string at `addr' in chunks of PRINTSTR_CHUNK
+ * and quote the first `size' of them, stopping at NUL if `asciz'.
+ * If `check_hex' is set, only check whether the string needs hex
+ * quoting and return the result.  Otherwise print the quoted string and
+ * return whether it ended with NUL; `usehex' is passed to quote_bytes,
+ * and can be -1 only if the string fits in one chunk.
+ * Returns -1 if the string cannot be read; if a later chunk cannot be
+ * read, the quoted part is printed and `*partial' is set.
+ */
+static int
+printstr_chunks(struct tcb *tcp, long addr, unsigned long size,
+		unsigned long total, bool asciz, int usehex, bool check_hex,
+		bool *partial)
+{
+	unsigned char *buf = arena_alloc(PRINTSTR_CHUNK);
+	char *outstr = arena_alloc(4 * PRINTSTR_CHUNK + 8);
+	unsigned long off;
+	int pending = -1;	/* last byte quoted, waiting for the next one */
+	int nul_seen = 0;
+
+	for (off = 0; off < total && !nul_seen; off += PRINTSTR_CHUNK) {
+		unsigned int m = MIN(total - off, PRINTSTR_CHUNK);
+		unsigned int n = size > off ? MIN(size - off, m) : 0;
+		const unsigned char *nul;
+		char *s = outstr, *e;
+		int rc, next;
+
+		rc = asciz ? umovestr(tcp, addr + off, m, (char *) buf)
+			   : umoven(tcp, addr + off, m, (char *) buf);
+		if (rc < 0) {
+			if (off == 0)
+				return -1;
+			if (!check_hex) {
+				if (pending >= 0) {
+					unsigned char c = pending;
+
+					s = quote_bytes(&c, 1, -1, usehex, s);
+				}
+				strcpy(s, "\"");
+				tprints(outstr);
+				*partial = true;
+			}
+			return 0;
+		}
+		if (rc > 0) {
+			nul = memchr(buf, '\0', m);
+			if (nul) {
+				nul_seen = 1;
+				if (nul - buf < n)
+					n = nul - buf;
+			}
+		}
+
+		if (check_hex) {
+			if (string_needs_hex(buf, n))
+				return 1;
+			continue;
+		}
+
+		if (off == 0)
+			*s++ = '\"';
+		if (pending >= 0) {
+			unsigned char c = pending;
+
+			s = quote_bytes(&c, 1, n ? buf[0] : -1, usehex, s);
+			pending = -1;
+		}
+		if (n == m && off + n < size && !nul_seen) {
+			/* The next byte is in the next chunk */
+			pending = buf[--n];
+		}
+		next = n < m && off + n < size ? buf[n] : -1;
+		e = quote_bytes(buf, n, next, usehex, s);
+		if (!e) {
+			/* With -x, the string turned out to need hex */
+			usehex = 1;
+			e = quote_bytes(buf, n, next, usehex, s);
+		}
+		*e = '\0';
+		tprints(outstr);
+	}
+
+	if (check_hex)
+		return 0;
+	if (pending >= 0) {
+		unsigned char c = pending;
+		char *s = quote_bytes(&c, 1, -1, usehex, outstr);
+
+		*s = '\0';
+		tprints(outstr);
+	}
+	if (total == 0)
+		tprints("\"");
+	tprints("\"");
+	return nul_seen;
+}
+
 /*
  * Print string specified by address `addr' and length `len'.
  * If `len' < 0, treat the string as a NUL-terminated string.
  * If string length exceeds `max_strlen', append `...' to the output.
+ *
+ * The string is read and quoted in chunks, so memory used for it
+ * does not depend on `max_strlen'.
  */
 void
 printstr(struct tcb *tcp, long addr, long len)
 {
-	static char *str = NULL;
-	static char *outstr;
-	int size;
-	int ellipsis;
+	void *mark;
+	unsigned long size, total;
+	bool asciz = (len == -1);
+	int usehex, rc;
+	bool partial = false;
 
 	if (!addr) {
 		tprints("NULL");
 		return;
 	}
-	/* Allocate static buffers if they are not allocated yet. */
-	if (!str) {
-		unsigned int outstr_size = 4 * max_strlen + /*for quotes and NUL:*/ 3;
-
-		if (outstr_size / 4 != max_strlen)
-			die_out_of_memory();
-		str = malloc(max_strlen + 1);
-		if (!str)
-			die_out_of_memory();
-		outstr = malloc(outstr_size);
-		if (!outstr)
-			die_out_of_memory();
-	}
 
-	if (len == -1) {
+	if (asciz) {
 		/*
 		 * Treat as a NUL-terminated string: fetch one byte more
-		 * because string_quote() quotes one byte less.
+		 * to find out whether the string is longer than max_strlen.
 		 */
-		size = max_strlen + 1;
-		if (umovestr(tcp, addr, size, str) < 0) {
-			tprintf("%#lx", addr);
-			return;
-		}
-	}
-	else {
+		size = max_strlen;
+		total = size + 1;
+	} else {
 		size = max_strlen;
 		if (size > (unsigned long)len)
 			size = (unsigned long)len;
-		if (umoven(tcp, addr, size, str) < 0) {
+		total = size;
+	}
+
+	mark = arena_mark();
+	usehex = 0;
+	if (xflag > 1)
+		usehex = 1;
+	else if (xflag && total <= PRINTSTR_CHUNK) {
+		/* Decided while quoting */
+		usehex = -1;
+	} else if (xflag) {
+		/* Hex-quote the whole string if any part of it needs it */
+		usehex = printstr_chunks(tcp, addr, size, total, asciz, 0, true,
+					 NULL);
+		if (usehex < 0) {
 			tprintf("%#lx", addr);
-			return;
+			goto out;
 		}
 	}
 
-	/* If string_quote didn't see NUL and (it was supposed to be ASCIZ str
-	 * or we were requested to print more than -s NUM chars)...
-	 */
-	ellipsis = (string_quote(str, outstr, len, size) &&
-			(len < 0 || len > max_strlen));
+	rc = printstr_chunks(tcp, addr, size, total, asciz, usehex, false,
+			     &partial);
+	if (rc < 0) {
+		tprintf("%#lx", addr);
+		goto out;
+	}
 
-	tprints(outstr);
-	if (ellipsis)
+	/* If only a part could be read, or we didn't see NUL and
+	 * (it was supposed to be ASCIZ str or we were requested
+	 * to print more than -s NUM chars)...
+	 */
+	if (partial || (!rc && (len < 0 || len > max_strlen)))
 		tprints("...");
+ out:
+	arena_release(mark);
+}
+
+/* Longest line: " | %08x  ", 16 hex bytes, 16 chars and " |\n" */
+#define HEXDUMP_LINE_MAX (3 + 8 + 2 + 16 * 3 + 2 + 16 + 3)
+#define HEXDUMP_CHUNK 4096
+
+/*
+ * Format one line of hex dump of `n' (at most 16) bytes at `src'
+ * at offset `offset' into `dst', return the end of the line.
+ */
+static char *
+hexdump_line(char *dst, unsigned offset, const unsigned char *src, int n)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *hexp, *ascii;
+	int i, width;
+
+	*dst++ = ' ';
+	*dst++ = '|';
+	*dst++ = ' ';
+	for (width = 5; width < 8 && (offset >> (width * 4)); width++)
+		;
+	while (width-- > 0)
+		*dst++ = hex[(offset >> (width * 4)) & 0xf];
+	memset(dst, ' ', 2 + 16 * 3 + 2 + 16);
+	hexp = dst + 2;
+	ascii = hexp + 16 * 3 + 2;
+	dst = ascii + 16;
+
+#ifdef __SSE2__
+	if (n == 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i *) src);
+		const __m128i nibble = _mm_set1_epi8(0xf);
+		const __m128i nine = _mm_set1_epi8(9);
+		const __m128i digit = _mm_set1_epi8('0');
+		const __m128i letter = _mm_set1_epi8('a' - '0' - 10);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+		__m128i lo = _mm_and_si128(v, nibble);
+		__m128i printable;
+		char pairs[32];
+
+		hi = _mm_add_epi8(_mm_add_epi8(hi, digit),
+				  _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letter));
+		lo = _mm_add_epi8(_mm_add_epi8(lo, digit),
+				  _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letter));
+		_mm_storeu_si128((__m128i *) pairs, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *) (pairs + 16),
+				 _mm_unpackhi_epi8(hi, lo));
+		for (i = 0; i < 16; i++)
+			memcpy(hexp + i * 3 + (i >= 8), pairs + i * 2, 2);
+
+		/* Bytes >= 0x80 are negative and fail the first comparison */
+		printable = _mm_and_si128(
+			_mm_cmpgt_epi8(v, _mm_set1_epi8(' ' - 1)),
+			_mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+		_mm_storeu_si128((__m128i *) ascii,
+			_mm_or_si128(_mm_and_si128(printable, v),
+				     _mm_andnot_si128(printable,
+						      _mm_set1_epi8('.'))));
+	} else
+#endif
+	for (i = 0; i < n; i++) {
+		hexp[i * 3 + (i >= 8)] = hex[src[i] >> 4];
+		hexp[i * 3 + (i >= 8) + 1] = hex[src[i] & 0xf];
+		ascii[i] = (src[i] >= ' ' && src[i] < 0x7f) ? src[i] : '.';
+	}
+
+	*dst++ = ' ';
+	*dst++ = '|';
+	*dst++ = '\n';
+	return dst;
+}
+
+/*
+ * Hex dump the first `limit' of `len' bytes at `addr', reading and
+ * formatting them HEXDUMP_CHUNK bytes at a time, and say how many
+ * were left out.  Return the number of bytes dumped.
+ */
+static unsigned long
+hexdump(struct tcb *tcp, long addr, unsigned long len, unsigned long limit)
+{
+	unsigned long off, size = len < limit ? len : limit;
+	unsigned char *buf;
+	char *out, *dst;
+	void *mark;
+	int i, n;
+
+	mark = arena_mark();
+	buf = arena_alloc(HEXDUMP_CHUNK);
+	out = arena_alloc(HEXDUMP_CHUNK / 16 * HEXDUMP_LINE_MAX + 1);
+	for (off = 0; off < size; off += n) {
+		n = size - off < HEXDUMP_CHUNK ? size - off : HEXDUMP_CHUNK;
+		if (umoven(tcp, addr + off, n, (char *) buf) < 0)
+			break;
+		dst = out;
+		for (i = 0; i < n; i += 16)
+			dst = hexdump_line(dst, off + i, buf + i,
+					   n - i < 16 ? n - i : 16);
+		*dst = '\0';
+		tprints(out);
+	}
+	arena_release(mark);
+	if (off < size)
+		return off;
+	if (len > size)
+		tprintf(" * %lu bytes not dumped\n", len - size);
+	return size;
 }
 
 #if HAVE_SYS_UIO_H
@@ -689,25 +1112,29 @@ dumpiov(struct tcb *tcp, int len, long addr)
 #endif
 	int i;
 	unsigned size;
+	unsigned long left;
+	void *mark;
 
 	size = sizeof_iov * len;
 	/* Assuming no sane program has millions of iovs */
-	if ((unsigned)len > 1024*1024 /* insane or negative size? */
-	    || (iov = malloc(size)) == NULL) {
+	if ((unsigned)len > 1024*1024 /* insane or negative size? */) {
 		fprintf(stderr, "Out of memory\n");
 		return;
 	}
+	left = dump_limit ? dump_limit : (unsigned long) -1;
+	mark = arena_mark();
+	iov = arena_alloc(size);
 	if (umoven(tcp, addr, size, (char *) iov) >= 0) {
 		for (i = 0; i < len; i++) {
 			/* include the buffer number to make it easy to
 			 * match up the trace with the source */
 			tprintf(" * %lu bytes in buffer %d\n",
 				(unsigned long)iov_iov_len(i), i);
-			dumpstr(tcp, (long) iov_iov_base(i),
-				iov_iov_len(i));
+			left -= hexdump(tcp, (long) iov_iov_base(i),
+					iov_iov_len(i), left);
 		}
 	}
-	free(iov);
+	arena_release(mark);
 #undef sizeof_iov
 #undef iov_iov_base
 #undef iov_iov_len
@@ -718,73 +1145,9 @@ dumpiov(struct tcb *tcp, int len, long addr)
 void
 dumpstr(struct tcb *tcp, long addr, int len)
 {
-	static int strsize = -1;
-	static unsigned char *str;
-
-	char outbuf[
-		(
-			(sizeof(
-			"xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx  "
-			"1234567890123456") + /*in case I'm off by few:*/ 4)
-		/*align to 8 to make memset easier:*/ + 7) & -8
-	];
-	const unsigned char *src;
-	int i;
-
-	memset(outbuf, ' ', sizeof(outbuf));
-
-	if (strsize < len + 16) {
-		free(str);
-		str = malloc(len + 16);
-		if (!str) {
-			strsize = -1;
-			fprintf(stderr, "Out of memory\n");
-			return;
-		}
-		strsize = len + 16;
-	}
-
-	if (umoven(tcp, addr, len, (char *) str) < 0)
+	if (len < 0)
 		return;
-
-	/* Space-pad to 16 bytes */
-	i = len;
-	while (i & 0xf)
-		str[i++] = ' ';
-
-	i = 0;
-	src = str;
-	while (i < len) {
-		char *dst = outbuf;
-		/* Hex dump */
-		do {
-			if (i < len) {
-				*dst++ = "0123456789abcdef"[*src >> 4];
-				*dst++ = "0123456789abcdef"[*src & 0xf];
-			}
-			else {
-				*dst++ = ' ';
-				*dst++ = ' ';
-			}
-			dst++; /* space is there by memset */
-			i++;
-			if ((i & 7) == 0)
-				dst++; /* space is there by memset */
-			src++;
-		} while (i & 0xf);
-		/* ASCII dump */
-		i -= 16;
-		src -= 16;
-		do {
-			if (*src >= ' ' && *src < 0x7f)
-				*dst++ = *src;
-			else
-				*dst++ = '.';
-			src++;
-		} while (++i & 0xf);
-		*dst = '\0';
-		tprintf(" | %05x  %s |\n", i - 16, outbuf);
-	}
+	hexdump(tcp, addr, len, dump_limit ? dump_limit : (unsigned long) len);
 }
 
 #ifdef HAVE_PROCESS_VM_READV
@@ -826,13 +1189,211 @@ static bool process_vm_readv_not_supported = 1;
 
 #endif /* end of hack */
 
+/*
+ * Tracee memory is read with the first of these that works:
+ * 1. process_vm_readv;
+ * 2. pread from /proc/PID/mem, kept open in tcp->mem_fd;
+ * 3. PTRACE_PEEKDATA, one word per call.
+ * The choice is made per tracee: process_vm_readv may be refused
+ * (e.g. by a seccomp policy) while /proc/PID/mem still works.
+ */
+#define vm_read_supported(tcp) \
+	(!((process_vm_readv_not_supported || ((tcp)->flags & TCB_NO_VM_READV)) \
+	   && ((tcp)->flags & TCB_NO_PROC_MEM)))
+
+void
+release_mem_fd(struct tcb *tcp)
+{
+	if (tcp->mem_fd >= 0)
+		close(tcp->mem_fd);
+	tcp->mem_fd = -1;
+	/* A new program may be accessible in a different way */
+	tcp->flags &= ~(TCB_NO_VM_READV | TCB_NO_PROC_MEM);
+}
+
+static int
+open_mem_fd(struct tcb *tcp)
+{
+	char path[sizeof("/proc/%u/mem") + sizeof(int)*3];
+
+	sprintf(path, "/proc/%u/mem", tcp->pid);
+	tcp->mem_fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (tcp->mem_fd < 0) {
+		if (debug_flag)
+			perror_msg("open(\"%s\")", path);
+		tcp->flags |= TCB_NO_PROC_MEM;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Read len bytes of tracee memory at addr with one call.
+ * Returns the number of bytes read, or -1 and errno.
+ * errno is ENOSYS if the tracee memory cannot be read this way:
+ * callers fall back to PTRACE_PEEKDATA then.
+ */
+static ssize_t
+vm_read(struct tcb *tcp, unsigned long addr, void *laddr, size_t len)
+{
+	ssize_t r;
+
+	if (!process_vm_readv_not_supported
+	 && !(tcp->flags & TCB_NO_VM_READV)) {
+		struct iovec local[1], remote[1];
+
+		local[0].iov_base = laddr;
+		remote[0].iov_base = (void *) addr;
+		local[0].iov_len = remote[0].iov_len = len;
+		r = process_vm_readv(tcp->pid, local, 1, remote, 1, 0);
+		if (r >= 0 || (errno != ENOSYS && errno != EPERM))
+			return r;
+		if (errno == ENOSYS)
+			process_vm_readv_not_supported = 1;
+		else
+			tcp->flags |= TCB_NO_VM_READV;
+	}
+
+	if (tcp->flags & TCB_NO_PROC_MEM) {
+		errno = ENOSYS;
+		return -1;
+	}
+	if (tcp->mem_fd < 0 && open_mem_fd(tcp) < 0) {
+		errno = ENOSYS;
+		return -1;
+	}
+	/*
+	 * The offset is signed: addresses above INT64_MAX cannot be read
+	 * this way, and on the arches where they exist they are not
+	 * user space anyway.
+	 */
+	if ((uint64_t) addr > (uint64_t) INT64_MAX - len) {
+		errno = EFAULT;
+		return -1;
+	}
+	r = pread64(tcp->mem_fd, laddr, len, (off64_t) addr);
+	if (r == 0 && len) {
+		/*
+		 * The descriptor refers to the address space
+		 * the tracee had before execve.
+		 */
+		close(tcp->mem_fd);
+		if (open_mem_fd(tcp) < 0) {
+			errno = ENOSYS;
+			return -1;
+		}
+		r = pread64(tcp->mem_fd, laddr, len, (off64_t) addr);
+	}
+	return r;
+}
+
+/* What vm_read has just used for tcp, to report its errors */
+static const char *
+vm_read_method(struct tcb *tcp)
+{
+	if (!process_vm_readv_not_supported
+	 && !(tcp->flags & TCB_NO_VM_READV))
+		return "process_vm_readv";
+	return "pread64 /proc/PID/mem";
+}
+
 #define PAGMASK	(~(PAGSIZ - 1))
+
+/*
+ * Cache of tracee memory, valid only while the tracee is stopped.
+ * During one stop, the same bytes are often read more than once,
+ * e.g. -P matching reads a path and then printpath reads it again.
+ * The cache is filled with 4K blocks, one process_vm_readv per block,
+ * and is invalidated by umove_cache_invalidate whenever the tracee
+ * is restarted.  A block never crosses a page boundary, so it either
+ * can be read in full or not at all.
+ */
+#define UMOVE_CACHE_BLOCK	4096
+#define UMOVE_CACHE_BLOCKS	8
+
+static struct {
+	unsigned long addr;
+	int pid;
+} umove_cache_tag[UMOVE_CACHE_BLOCKS];
+static char umove_cache_data[UMOVE_CACHE_BLOCKS][UMOVE_CACHE_BLOCK];
+static unsigned int umove_cache_used, umove_cache_next;
+static unsigned long umove_cache_hits, umove_cache_misses;
+
+void
+umove_cache_invalidate(void)
+{
+	umove_cache_used = 0;
+}
+
+void
+umove_cache_stats(void)
+{
+	unsigned long total = umove_cache_hits + umove_cache_misses;
+
+	fprintf(stderr, "umove cache: %lu hits, %lu misses, %lu%% hit rate\n",
+		umove_cache_hits, umove_cache_misses,
+		total ? umove_cache_hits * 100 / total : 0);
+}
+
+/* Returns the block of tracee memory containing addr, or NULL */
+static const char *
+umove_cache_block(struct tcb *tcp, unsigned long addr)
+{
+	unsigned int i;
+
+	addr &= -(unsigned long) UMOVE_CACHE_BLOCK;
+	for (i = 0; i < umove_cache_used; ++i) {
+		if (umove_cache_tag[i].addr == addr
+		 && umove_cache_tag[i].pid == tcp->pid) {
+			++umove_cache_hits;
+			return umove_cache_data[i];
+		}
+	}
+
+	if (umove_cache_used < UMOVE_CACHE_BLOCKS)
+		i = umove_cache_used++;
+	else
+		i = umove_cache_next++ % UMOVE_CACHE_BLOCKS;
+	if (vm_read(tcp, addr, umove_cache_data[i], UMOVE_CACHE_BLOCK)
+	    != UMOVE_CACHE_BLOCK) {
+		umove_cache_tag[i].pid = 0;
+		return NULL;
+	}
+	++umove_cache_misses;
+	umove_cache_tag[i].addr = addr;
+	umove_cache_tag[i].pid = tcp->pid;
+	return umove_cache_data[i];
+}
+
+/*
+ * Read small objects through the cache.  Returns -1 if some block
+ * cannot be read, the caller falls back to exact reads then.
+ */
+static int
+umove_cache_read(struct tcb *tcp, unsigned long addr, int len, char *laddr)
+{
+	const char *block;
+	unsigned int off, m;
+
+	while (len > 0) {
+		block = umove_cache_block(tcp, addr);
+		if (!block)
+			return -1;
+		off = addr & (UMOVE_CACHE_BLOCK - 1);
+		m = MIN(UMOVE_CACHE_BLOCK - off, (unsigned int) len);
+		memcpy(laddr, block + off, m);
+		addr += m;
+		laddr += m;
+		len -= m;
+	}
+	return 0;
+}
 /*
  * move `len' bytes of data from process `pid'
  * at address `addr' to our space at `laddr'
  */
-int
-umoven(struct tcb *tcp, long addr, int len, char *laddr)
+static int
+umoven_tracee(struct tcb *tcp, long addr, int len, char *laddr)
 {
 	int pid = tcp->pid;
 	int n, m, nread;
@@ -846,24 +1407,25 @@ umoven(struct tcb *tcp, long addr, int len, char *laddr)
 		addr &= (1ul << 8 * current_wordsize) - 1;
 #endif
 
-	if (!process_vm_readv_not_supported) {
-		struct iovec local[1], remote[1];
+	/* Bigger reads would only wash the cache out */
+	if (vm_read_supported(tcp) && len <= UMOVE_CACHE_BLOCK
+	 && umove_cache_read(tcp, addr, len, laddr) == 0)
+		return 0;
+
+	if (vm_read_supported(tcp)) {
 		int r;
 
-		local[0].iov_base = laddr;
-		remote[0].iov_base = (void*)addr;
-		local[0].iov_len = remote[0].iov_len = len;
-		r = process_vm_readv(pid, local, 1, remote, 1, 0);
+		r = vm_read(tcp, addr, laddr, len);
 		if (r == len)
 			return 0;
 		if (r >= 0) {
-			error_msg("umoven: short read (%d < %d) @0x%lx",
-				  r, len, addr);
+			error_msg("umoven: short read (%d < %d) @0x%lx by %s",
+				  r, len, addr, vm_read_method(tcp));
 			return -1;
 		}
 		switch (errno) {
 			case ENOSYS:
-				process_vm_readv_not_supported = 1;
+				/* PTRACE_PEEKDATA is the only way left */
 				break;
 			case ESRCH:
 				/* the process is gone */
@@ -873,7 +1435,8 @@ umoven(struct tcb *tcp, long addr, int len, char *laddr)
 				return -1;
 			default:
 				/* all the rest is strange and should be reported */
-				perror_msg("process_vm_readv");
+				perror_msg("umoven: %s pid:%d @0x%lx",
+					   vm_read_method(tcp), pid, addr);
 				return -1;
 		}
 	}
@@ -952,8 +1515,8 @@ umoven(struct tcb *tcp, long addr, int len, char *laddr)
  * in laddr[] _after_ terminating NUL (but, of course,
  * we never write past laddr[len-1]).
  */
-int
-umovestr(struct tcb *tcp, long addr, int len, char *laddr)
+static int
+umovestr_tracee(struct tcb *tcp, long addr, int len, char *laddr)
 {
 #if SIZEOF_LONG == 4
 	const unsigned long x01010101 = 0x01010101ul;
@@ -978,7 +1541,25 @@ umovestr(struct tcb *tcp, long addr, int len, char *laddr)
 #endif
 
 	nread = 0;
-	if (!process_vm_readv_not_supported) {
+	while (vm_read_supported(tcp) && len > 0) {
+		const char *block = umove_cache_block(tcp, addr);
+
+		if (!block)
+			break;
+		n = addr & (UMOVE_CACHE_BLOCK - 1);
+		m = MIN(UMOVE_CACHE_BLOCK - n, len);
+		memcpy(laddr, block + n, m);
+		if (memchr(block + n, '\0', m))
+			return 1;
+		addr += m;
+		laddr += m;
+		nread += m;
+		len -= m;
+	}
+	if (len == 0)
+		return 0;
+
+	if (vm_read_supported(tcp)) {
 		struct iovec local[1], remote[1];
 
 		local[0].iov_base = laddr;
@@ -1004,7 +1585,8 @@ umovestr(struct tcb *tcp, long addr, int len, char *laddr)
 				chunk_len = r; /* chunk_len -= end_in_page */
 
 			local[0].iov_len = remote[0].iov_len = chunk_len;
-			r = process_vm_readv(pid, local, 1, remote, 1, 0);
+			r = vm_read(tcp, (unsigned long) remote[0].iov_base,
+				    local[0].iov_base, chunk_len);
 			if (r > 0) {
 				if (memchr(local[0].iov_base, '\0', r))
 					return 1;
@@ -1016,7 +1598,6 @@ umovestr(struct tcb *tcp, long addr, int len, char *laddr)
 			}
 			switch (errno) {
 				case ENOSYS:
-					process_vm_readv_not_supported = 1;
 					goto vm_readv_didnt_work;
 				case ESRCH:
 					/* the process is gone */
@@ -1024,13 +1605,15 @@ umovestr(struct tcb *tcp, long addr, int len, char *laddr)
 				case EFAULT: case EIO: case EPERM:
 					/* address space is inaccessible */
 					if (nread) {
-						perror_msg("umovestr: short read (%d < %d) @0x%lx",
-							   nread, nread + len, addr);
+						perror_msg("umovestr: short read (%d < %d) @0x%lx by %s",
+							   nread, nread + len, addr,
+							   vm_read_method(tcp));
 					}
 					return -1;
 				default:
 					/* all the rest is strange and should be reported */
-					perror_msg("process_vm_readv");
+					perror_msg("umovestr: %s pid:%d @0x%lx",
+						   vm_read_method(tcp), pid, addr);
 					return -1;
 			}
 		}
@@ -1105,6 +1688,147 @@ umovestr(struct tcb *tcp, long addr, int len, char *laddr)
 	return 0;
 }
 
+/*
+ * With --binary, what the decoders fetch from the tracee is recorded,
+ * with --decode, it is taken from the capture.
+ */
+int
+umoven(struct tcb *tcp, long addr, int len, char *laddr)
+{
+	int rc;
+
+	if (capture_decoding)
+		return capture_get_mem(addr, len, laddr);
+	rc = umoven_tracee(tcp, addr, len, laddr);
+	if (capture_enabled)
+		capture_put_mem(addr, len, rc, laddr);
+	return rc;
+}
+
+int
+umovestr(struct tcb *tcp, long addr, int len, char *laddr)
+{
+	int rc;
+
+	if (capture_decoding)
+		return capture_get_str(addr, len, laddr);
+	rc = umovestr_tracee(tcp, addr, len, laddr);
+	if (capture_enabled)
+		capture_put_str(addr, len, rc, laddr);
+	return rc;
+}
+
+/*
+ * Vectored counterparts of umoven.  Decoders that read many small
+ * objects (array elements, structures pointed to by array elements)
+ * describe them with struct umove_req and get them all with one
+ * process_vm_readv call instead of one call per object.
+ */
+#define UMOVE_MULTI_MAX 64
+
+/*
+ * Read n <= UMOVE_MULTI_MAX requests with one process_vm_readv call.
+ * Returns the number of leading requests read in full.
+ */
+static unsigned int
+vm_readv_reqs(struct tcb *tcp, struct umove_req *req, unsigned int n)
+{
+	struct iovec local[UMOVE_MULTI_MAX], remote[UMOVE_MULTI_MAX];
+	unsigned int i;
+	long addr;
+	ssize_t r;
+
+	for (i = 0; i < n; ++i) {
+		addr = req[i].addr;
+#if SUPPORTED_PERSONALITIES > 1 && SIZEOF_LONG > 4
+		if (current_wordsize < sizeof(addr))
+			addr &= (1ul << 8 * current_wordsize) - 1;
+#endif
+		local[i].iov_base = req[i].laddr;
+		remote[i].iov_base = (void *) addr;
+		local[i].iov_len = remote[i].iov_len = req[i].len;
+	}
+	r = process_vm_readv(tcp->pid, local, n, remote, n, 0);
+	if (r < 0) {
+		if (errno == ENOSYS)
+			process_vm_readv_not_supported = 1;
+		else if (errno == EPERM)
+			tcp->flags |= TCB_NO_VM_READV;
+		return 0;
+	}
+	for (i = 0; i < n && (size_t) r >= req[i].len; ++i) {
+		r -= req[i].len;
+		req[i].rc = 0;
+	}
+	return i;
+}
+
+/*
+ * Read all requests, setting their rc.
+ * Returns the number of requests that could not be read.
+ */
+unsigned int
+umoven_multi(struct tcb *tcp, struct umove_req *req, unsigned int n)
+{
+	unsigned int i = 0, cnt, done, failed = 0;
+
+	while (i < n) {
+		if (!capture_enabled && !capture_decoding
+		 && !process_vm_readv_not_supported
+		 && !(tcp->flags & TCB_NO_VM_READV)) {
+			cnt = MIN(n - i, UMOVE_MULTI_MAX);
+			done = vm_readv_reqs(tcp, req + i, cnt);
+			i += done;
+			if (done == cnt)
+				continue;
+		}
+		/*
+		 * The first request that was not read in full:
+		 * umoven knows how to report it.
+		 */
+		req[i].rc = umoven(tcp, req[i].addr, req[i].len, req[i].laddr);
+		if (req[i].rc < 0)
+			++failed;
+		++i;
+	}
+	return failed;
+}
+
+/*
+ * Read up to n elements of size elsize of the tracee array at addr
+ * into buf, stopping at the first element that cannot be read.
+ * Returns the number of elements read.
+ */
+unsigned int
+umove_array(struct tcb *tcp, long addr, unsigned int elsize,
+	    unsigned int n, void *buf)
+{
+	struct umove_req req[UMOVE_MULTI_MAX];
+	unsigned int done = 0, cnt, i;
+
+	while (done < n) {
+		if (!capture_enabled && !capture_decoding
+		 && !process_vm_readv_not_supported
+		 && !(tcp->flags & TCB_NO_VM_READV)) {
+			cnt = MIN(n - done, ARRAY_SIZE(req));
+			for (i = 0; i < cnt; ++i) {
+				req[i].addr = addr + (done + i) * elsize;
+				req[i].len = elsize;
+				req[i].laddr = (char *) buf + (done + i) * elsize;
+			}
+			i = vm_readv_reqs(tcp, req, cnt);
+			done += i;
+			if (i == cnt)
+				continue;
+		}
+		if (umoven(tcp, addr + done * elsize, elsize,
+			   (char *) buf + done * elsize) < 0)
+			break;
+		++done;
+	}
+	return done;
+}
+
 int
 upeek(int pid, long off, long *res)
 {